@@ -7,6 +7,7 @@
 #ifndef AURORACOIN_ADDRMAN_H
 #define AURORACOIN_ADDRMAN_H
 
+#include <crypto/siphash.h>
 #include <netaddress.h>
 #include <protocol.h>
 #include <random.h>
@@ -14,9 +15,13 @@
 #include <timedata.h>
 #include <util/system.h>
 
+#include <atomic>
+#include <limits>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdint.h>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -170,6 +175,32 @@ public:
 //! the maximum time we'll spend trying to resolve a tried table collision, in seconds
 static const int64_t ADDRMAN_TEST_WINDOW = 40*60; // 40 minutes
 
+//! how long GetAddrSnapshot() keeps answering from the same selection, in seconds
+static const int64_t ADDRMAN_GETADDR_SNAPSHOT_INTERVAL = 10*60; // 10 minutes
+
+/**
+ * Salted hasher for network addresses. The salt keeps peers, who choose the
+ * addresses they send us, from steering entries into one hash bucket.
+ */
+class CNetAddrHasher
+{
+private:
+    const uint64_t k0, k1;
+
+public:
+    CNetAddrHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const CNetAddr& addr) const
+    {
+        uint64_t nHigh = 0, nLow = 0;
+        for (int n = 0; n < 8; n++) {
+            nLow |= uint64_t{addr.GetByte(n)} << (8 * n);
+            nHigh |= uint64_t{addr.GetByte(n + 8)} << (8 * n);
+        }
+        return CSipHasher(k0, k1).Write(nLow).Write(nHigh).Finalize();
+    }
+};
+
 /**
  * Stochastical (IP) address manager
  */
@@ -184,14 +215,17 @@ private:
     int nIdCount GUARDED_BY(cs);
 
     //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    std::unordered_map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
 
     //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    std::unordered_map<CNetAddr, int, CNetAddrHasher> mapAddr GUARDED_BY(cs);
 
     //! randomly-ordered vector of all nIds
     std::vector<int> vRandom GUARDED_BY(cs);
 
+    //! vRandom.size(), readable without taking cs
+    std::atomic<size_t> m_size{0};
+
     // number of "tried" entries
     int nTried GUARDED_BY(cs);
 
@@ -210,6 +244,16 @@ private:
     //! Holds addrs inserted into tried table that collide with existing entries. Test-before-evict discipline used to resolve these collisions.
     std::set<int> m_tried_collisions;
 
+    //! protects the GetAddrSnapshot() selection; taken before cs, never while holding it
+    CCriticalSection cs_addr_snapshot;
+
+    //! selection handed out by GetAddrSnapshot(), and the time it was made
+    std::shared_ptr<const std::vector<CAddress>> m_addr_snapshot GUARDED_BY(cs_addr_snapshot);
+    int64_t m_addr_snapshot_time GUARDED_BY(cs_addr_snapshot){0};
+
+    //! set by Clear() to make the next GetAddrSnapshot() select afresh
+    std::atomic<bool> m_addr_snapshot_stale{true};
+
 protected:
     //! secret key to randomize bucket select with
     uint256 nKey;
@@ -384,6 +428,7 @@ public:
             mapAddr[info] = n;
             info.nRandomPos = vRandom.size();
             vRandom.push_back(n);
+            m_size = vRandom.size();
             if (nVersion != 1 || nUBuckets != ADDRMAN_NEW_BUCKET_COUNT) {
                 // In case the new table data cannot be used (nVersion unknown, or bucket count wrong),
                 // immediately try to give them a reference based on their primary source address.
@@ -408,6 +453,7 @@ public:
                 info.nRandomPos = vRandom.size();
                 info.fInTried = true;
                 vRandom.push_back(nIdCount);
+                m_size = vRandom.size();
                 mapInfo[nIdCount] = info;
                 mapAddr[info] = nIdCount;
                 vvTried[nKBucket][nKBucketPos] = nIdCount;
@@ -438,9 +484,9 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
+        for (std::unordered_map<int, CAddrInfo>::const_iterator it = mapInfo.begin(); it != mapInfo.end(); ) {
             if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                std::unordered_map<int, CAddrInfo>::const_iterator itCopy = it++;
                 Delete(itCopy->first);
                 nLostUnk++;
             } else {
@@ -450,6 +496,7 @@ public:
         if (nLost + nLostUnk > 0) {
             LogPrint(BCLog::ADDRMAN, "addrman lost %i new and %i tried addresses due to collisions\n", nLostUnk, nLost);
         }
+        m_size = vRandom.size();
 
         Check();
     }
@@ -476,6 +523,8 @@ public:
         nLastGood = 1; //Initially at 1 so that "never" is strictly worse.
         mapInfo.clear();
         mapAddr.clear();
+        m_size = 0;
+        m_addr_snapshot_stale = true;
     }
 
     CAddrMan()
@@ -491,8 +540,7 @@ public:
     //! Return the number of (unique) addresses in all tables.
     size_t size() const
     {
-        LOCK(cs); // TODO: Cache this in an atomic to avoid this overhead
-        return vRandom.size();
+        return m_size;
     }
 
     //! Consistency check
@@ -605,6 +653,26 @@ public:
         return vAddr;
     }
 
+    /**
+     * Return a bunch of addresses, selected at random. The same selection is
+     * returned for ADDRMAN_GETADDR_SNAPSHOT_INTERVAL seconds, so answering
+     * getaddr requests neither contends on cs nor lets peers map our address
+     * table by asking repeatedly.
+     */
+    std::vector<CAddress> GetAddrSnapshot(int64_t nNow = GetTime())
+    {
+        std::shared_ptr<const std::vector<CAddress>> snapshot;
+        {
+            LOCK(cs_addr_snapshot);
+            if (m_addr_snapshot_stale.exchange(false) || !m_addr_snapshot || nNow < m_addr_snapshot_time || nNow >= m_addr_snapshot_time + ADDRMAN_GETADDR_SNAPSHOT_INTERVAL) {
+                m_addr_snapshot = std::make_shared<const std::vector<CAddress>>(GetAddr());
+                m_addr_snapshot_time = nNow;
+            }
+            snapshot = m_addr_snapshot;
+        }
+        return *snapshot;
+    }
+
     //! Mark an entry as currently-connected-to.
     void Connected(const CService &addr, int64_t nTime = GetAdjustedTime())
     {
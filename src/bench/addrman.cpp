@@ -0,0 +1,114 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <addrman.h>
+#include <random.h>
+#include <util/time.h>
+
+#include <cassert>
+#include <vector>
+
+/* A "source" is a source address from which we have received a bunch of other addresses. */
+
+static constexpr size_t NUM_SOURCES = 256;
+static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 400;
+
+static CNetAddr RandomIPv4(FastRandomContext& rng)
+{
+    struct in_addr addr;
+    addr.s_addr = (uint32_t)rng.rand32();
+    // Keep the addresses routable, otherwise addrman drops them.
+    reinterpret_cast<unsigned char*>(&addr.s_addr)[0] = 1 + rng.randrange(223);
+    return CNetAddr(addr);
+}
+
+struct AddrManFixture {
+    std::vector<CAddress> sources;
+    std::vector<std::vector<CAddress>> addresses;
+
+    AddrManFixture()
+    {
+        FastRandomContext rng(true);
+        const int64_t nNow = GetTime();
+        sources.resize(NUM_SOURCES);
+        addresses.resize(NUM_SOURCES);
+        for (size_t source_i = 0; source_i < NUM_SOURCES; source_i++) {
+            sources[source_i] = CAddress(CService(RandomIPv4(rng), 12340), NODE_NETWORK);
+            for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; addr_i++) {
+                CAddress addr(CService(RandomIPv4(rng), 12340), NODE_NETWORK);
+                addr.nTime = nNow - rng.randrange(7 * 24 * 60 * 60);
+                addresses[source_i].push_back(addr);
+            }
+        }
+    }
+
+    /** Add every address, one addr message per source, as a busy seed node would. */
+    void FillAddrMan(CAddrMan& addrman) const
+    {
+        for (size_t source_i = 0; source_i < NUM_SOURCES; source_i++) {
+            addrman.Add(addresses[source_i], sources[source_i]);
+        }
+    }
+
+    /** Fill both tables, moving every 8th address to tried. */
+    void FillAddrManWithTried(CAddrMan& addrman) const
+    {
+        FillAddrMan(addrman);
+        for (size_t source_i = 0; source_i < NUM_SOURCES; source_i++) {
+            for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; addr_i += 8) {
+                addrman.Good(addresses[source_i][addr_i]);
+            }
+        }
+    }
+};
+
+static void AddrManAdd(benchmark::State& state)
+{
+    const AddrManFixture fixture;
+    while (state.KeepRunning()) {
+        CAddrMan addrman;
+        fixture.FillAddrMan(addrman);
+    }
+}
+
+static void AddrManSelect(benchmark::State& state)
+{
+    const AddrManFixture fixture;
+    CAddrMan addrman;
+    fixture.FillAddrManWithTried(addrman);
+    assert(addrman.size() > 50000);
+    while (state.KeepRunning()) {
+        const CAddrInfo address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManGetAddr(benchmark::State& state)
+{
+    const AddrManFixture fixture;
+    CAddrMan addrman;
+    fixture.FillAddrManWithTried(addrman);
+    while (state.KeepRunning()) {
+        const std::vector<CAddress> addresses = addrman.GetAddr();
+        assert(addresses.size() > 0);
+    }
+}
+
+static void AddrManGetAddrSnapshot(benchmark::State& state)
+{
+    const AddrManFixture fixture;
+    CAddrMan addrman;
+    fixture.FillAddrManWithTried(addrman);
+    while (state.KeepRunning()) {
+        const std::vector<CAddress> addresses = addrman.GetAddrSnapshot();
+        assert(addresses.size() > 0);
+    }
+}
+
+BENCHMARK(AddrManAdd, 5);
+BENCHMARK(AddrManSelect, 200000);
+BENCHMARK(AddrManGetAddr, 500);
+BENCHMARK(AddrManGetAddrSnapshot, 5000);
@@ -3,8 +3,12 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
+#include <random.h>
 #include <test/util.h>
 #include <txmempool.h>
 #include <validation.h>
@@ -50,3 +54,76 @@ static void AssembleBlock(benchmark::State& state)
 }
 
 BENCHMARK(AssembleBlock, 700);
+
+/**
+ * Template latency with 100k transactions in the mempool: one transaction
+ * spending each output of a few confirmed transactions that spend a coinbase
+ * to 10000 outputs, far more than fits in a block.
+ */
+static void BlockTemplateLargeMempool(benchmark::State& state, bool keep_selection)
+{
+    const CScript SCRIPT_PUB{CScript() << OP_TRUE};
+    constexpr size_t NUM_FANOUTS{10};
+    constexpr size_t NUM_OUTPUTS{10000};
+
+    std::vector<COutPoint> coinbases;
+    for (size_t b{0}; b < NUM_FANOUTS; ++b) {
+        coinbases.push_back(MineBlock(SCRIPT_PUB).prevout);
+    }
+    for (int b{0}; b < COINBASE_MATURITY; ++b) {
+        MineBlock(SCRIPT_PUB);
+    }
+
+    // Confirm each fanout in its own block, so the spends are not all in one cluster
+    std::vector<CTransactionRef> fanouts;
+    for (const COutPoint& coinbase : coinbases) {
+        CMutableTransaction fanout;
+        fanout.vin.emplace_back(coinbase);
+        {
+            LOCK2(cs_main, ::mempool.cs);
+            const CAmount value{::ChainstateActive().CoinsTip().AccessCoin(coinbase).out.nValue};
+            fanout.vout.assign(NUM_OUTPUTS, CTxOut((value - COIN / 10) / NUM_OUTPUTS, SCRIPT_PUB));
+            fanouts.push_back(MakeTransactionRef(fanout));
+            LockPoints lp;
+            ::mempool.addUnchecked(CTxMemPoolEntry(fanouts.back(), value - fanouts.back()->GetValueOut(), /* time */ 0, /* height */ 1, /* spendsCoinbase */ true, /* sigOpCost */ 0, lp));
+        }
+        MineBlock(SCRIPT_PUB);
+    }
+
+    FastRandomContext rng(true);
+    int algo;
+    {
+        LOCK2(cs_main, ::mempool.cs);
+        assert(::mempool.size() == 0);
+        LockPoints lp;
+        for (const CTransactionRef& fanout : fanouts) {
+            for (uint32_t n{0}; n < NUM_OUTPUTS; ++n) {
+                CMutableTransaction tx;
+                tx.vin.emplace_back(fanout->GetHash(), n);
+                const CAmount fee{1000 + (CAmount)rng.randrange(100000)};
+                tx.vout.emplace_back(fanout->vout[n].nValue - fee, SCRIPT_PUB);
+                ::mempool.addUnchecked(CTxMemPoolEntry(MakeTransactionRef(tx), fee, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 0, lp));
+            }
+        }
+        // As PrepareBlock, keep clear of the limit on sequential blocks of one algo
+        const CBlockIndex* tip{::ChainActive().Tip()};
+        algo = IsAlgoActive(tip, Params().GetConsensus(), ALGO_SHA256D) ? tip->nHeight % NUM_ALGOS : ALGO_SCRYPT;
+    }
+
+    // Nothing changes the mempool while this runs, so the candidate needs no events
+    g_block_candidate = MakeUnique<BlockTemplateCandidate>();
+    while (state.KeepRunning()) {
+        if (!keep_selection) g_block_candidate->Invalidate();
+        BlockAssembler{Params()}.CreateNewBlock(SCRIPT_PUB, algo);
+    }
+    g_block_candidate.reset();
+
+    LOCK(::mempool.cs);
+    ::mempool.clear();
+}
+
+static void BlockTemplate100kFullSelection(benchmark::State& state) { BlockTemplateLargeMempool(state, false); }
+static void BlockTemplate100kKeptSelection(benchmark::State& state) { BlockTemplateLargeMempool(state, true); }
+
+BENCHMARK(BlockTemplate100kFullSelection, 5);
+BENCHMARK(BlockTemplate100kKeptSelection, 20);
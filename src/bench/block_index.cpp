@@ -0,0 +1,103 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <random.h>
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+// Size of the synthetic block index, in the order of a few years of
+// multi-algo blocks.
+static const int BLOCK_INDEX_SIZE = 2 * 1000 * 1000;
+static const int ANCESTOR_LOOKUPS = 1000;
+
+static void LinkChain(std::vector<CBlockIndex*>& chain)
+{
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i]->nHeight = i;
+        chain[i]->pprev = i ? chain[i - 1] : nullptr;
+        chain[i]->BuildSkip();
+    }
+}
+
+// Entries allocated one by one from the heap, in a random order relative to
+// height, like the entries LoadBlockIndexGuts creates in database key order.
+static void BuildHeapIndex(std::vector<std::unique_ptr<CBlockIndex>>& storage, std::vector<CBlockIndex*>& chain)
+{
+    storage.resize(BLOCK_INDEX_SIZE);
+    for (auto& entry : storage) entry.reset(new CBlockIndex());
+    chain.resize(BLOCK_INDEX_SIZE);
+    for (size_t i = 0; i < chain.size(); i++) chain[i] = storage[i].get();
+    FastRandomContext rng(true);
+    std::shuffle(chain.begin(), chain.end(), rng);
+    LinkChain(chain);
+}
+
+// Entries laid out in height order in an arena, as after LoadBlockIndex.
+static void BuildArenaIndex(CBlockIndexArena& arena, std::vector<CBlockIndex*>& chain)
+{
+    arena.Reserve(BLOCK_INDEX_SIZE);
+    chain.resize(BLOCK_INDEX_SIZE);
+    for (auto& entry : chain) entry = arena.Allocate();
+    LinkChain(chain);
+}
+
+static void GetAncestors(benchmark::State& state, const std::vector<CBlockIndex*>& chain)
+{
+    FastRandomContext rng(true);
+    std::vector<std::pair<int, int>> lookups;
+    for (int i = 0; i < ANCESTOR_LOOKUPS; i++) {
+        int from = rng.randrange(BLOCK_INDEX_SIZE);
+        lookups.emplace_back(from, rng.randrange(from + 1));
+    }
+    while (state.KeepRunning()) {
+        for (const auto& lookup : lookups) {
+            assert(chain[lookup.first]->GetAncestor(lookup.second) == chain[lookup.second]);
+        }
+    }
+}
+
+static void BlockIndexBuildHeap(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        std::vector<std::unique_ptr<CBlockIndex>> storage;
+        std::vector<CBlockIndex*> chain;
+        BuildHeapIndex(storage, chain);
+    }
+}
+
+static void BlockIndexBuildArena(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        CBlockIndexArena arena;
+        std::vector<CBlockIndex*> chain;
+        BuildArenaIndex(arena, chain);
+    }
+}
+
+static void BlockIndexGetAncestorHeap(benchmark::State& state)
+{
+    std::vector<std::unique_ptr<CBlockIndex>> storage;
+    std::vector<CBlockIndex*> chain;
+    BuildHeapIndex(storage, chain);
+    GetAncestors(state, chain);
+}
+
+static void BlockIndexGetAncestorArena(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> chain;
+    BuildArenaIndex(arena, chain);
+    GetAncestors(state, chain);
+}
+
+BENCHMARK(BlockIndexBuildHeap, 1);
+BENCHMARK(BlockIndexBuildArena, 2);
+BENCHMARK(BlockIndexGetAncestorHeap, 100);
+BENCHMARK(BlockIndexGetAncestorArena, 200);
@@ -0,0 +1,68 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <consensus/merkle.h>
+#include <random.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static CTransactionRef MakeUniqueTransaction(FastRandomContext& rng)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(rng.rand256(), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].scriptWitness.stack.push_back({1});
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = COIN;
+    return MakeTransactionRef(tx);
+}
+
+/**
+ * Reconstruct a 2000 transaction compact block against a mempool of the
+ * given size. One transaction is missing from the mempool, so the whole
+ * mempool is looked at, as it is when any transaction has to be requested.
+ */
+static void CompactBlockReconstruct(benchmark::State& state, size_t mempool_size)
+{
+    FastRandomContext rng(true);
+    CTxMemPool pool;
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vout.resize(1);
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < mempool_size; i++) {
+            const CTransactionRef tx = MakeUniqueTransaction(rng);
+            LockPoints lp;
+            pool.addUnchecked(CTxMemPoolEntry(tx, /* fee */ 1000, /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+            if (i % (mempool_size / 2000) == 0 && block.vtx.size() < 2000) block.vtx.push_back(tx);
+        }
+    }
+    block.vtx.push_back(MakeUniqueTransaction(rng));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.nBits = 0x207fffff;
+    const CBlockHeaderAndShortTxIDs cmpctblock(block, true);
+    const std::vector<std::pair<uint256, CTransactionRef>> extra_txn;
+
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partial_block(&pool);
+        bool ok = partial_block.InitData(cmpctblock, extra_txn) == READ_STATUS_OK;
+        assert(ok);
+        assert(!partial_block.IsTxAvailable(block.vtx.size() - 1));
+    }
+}
+
+static void CompactBlockReconstruct50k(benchmark::State& state) { CompactBlockReconstruct(state, 50000); }
+static void CompactBlockReconstruct300k(benchmark::State& state) { CompactBlockReconstruct(state, 300000); }
+
+BENCHMARK(CompactBlockReconstruct50k, 100);
+BENCHMARK(CompactBlockReconstruct300k, 20);
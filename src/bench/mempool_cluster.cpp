@@ -0,0 +1,72 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& prevouts, size_t num_outputs)
+{
+    CMutableTransaction tx;
+    for (const COutPoint& prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+        tx.vin.back().scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(num_outputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+/**
+ * Add the transactions, each paying a random fee, then mine the first one
+ * and evict the rest, as the worst case under the ancestor and descendant
+ * limits for joining, splitting and evicting a cluster.
+ */
+static void MempoolCluster(benchmark::State& state, const std::vector<CTransactionRef>& txs)
+{
+    FastRandomContext rng(true);
+    std::vector<CAmount> fees;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        fees.push_back(1000 + rng.randrange(100000));
+    }
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    LockPoints lp;
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < txs.size(); ++i) {
+            pool.addUnchecked(CTxMemPoolEntry(txs[i], fees[i], /* time */ 0, /* height */ 1, /* spendsCoinbase */ false, /* sigOpCost */ 4, lp));
+        }
+        pool.removeForBlock({txs.front()}, 1);
+        pool.TrimToSize(0);
+        assert(pool.size() == 0);
+    }
+}
+
+static void MempoolClusterLongChain(benchmark::State& state)
+{
+    std::vector<CTransactionRef> txs{MakeTx({COutPoint(uint256S("01"), 0)}, 1)};
+    while (txs.size() < DEFAULT_ANCESTOR_LIMIT) {
+        txs.push_back(MakeTx({COutPoint(txs.back()->GetHash(), 0)}, 1));
+    }
+    MempoolCluster(state, txs);
+}
+
+static void MempoolClusterWideFanout(benchmark::State& state)
+{
+    std::vector<CTransactionRef> txs{MakeTx({COutPoint(uint256S("01"), 0)}, DEFAULT_DESCENDANT_LIMIT - 1)};
+    for (uint32_t n = 0; n < DEFAULT_DESCENDANT_LIMIT - 1; ++n) {
+        txs.push_back(MakeTx({COutPoint(txs.front()->GetHash(), n)}, 1));
+    }
+    MempoolCluster(state, txs);
+}
+
+BENCHMARK(MempoolClusterLongChain, 2000);
+BENCHMARK(MempoolClusterWideFanout, 2000);
@@ -0,0 +1,108 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <hash.h>
+#include <net.h>
+#include <protocol.h>
+#include <random.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <version.h>
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+static const size_t STREAM_MESSAGES = 2000;
+
+/** Append a message with a random payload of nSize bytes to the stream. */
+static void AppendMessage(std::vector<unsigned char>& stream, const char* command, size_t nSize, FastRandomContext& rng)
+{
+    const std::vector<unsigned char> payload = rng.randbytes(nSize);
+    CMessageHeader hdr(Params().MessageStart(), command, payload.size());
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, stream, stream.size(), hdr};
+    stream.insert(stream.end(), payload.begin(), payload.end());
+}
+
+/**
+ * A stream shaped like the traffic of a peer relaying transactions and
+ * blocks: mostly small inv messages, transactions, and an occasional block.
+ */
+static std::vector<unsigned char> MakeMessageStream()
+{
+    FastRandomContext rng(true);
+    std::vector<unsigned char> stream;
+    for (size_t i = 0; i < STREAM_MESSAGES; i++) {
+        const uint64_t kind = rng.randrange(100);
+        if (kind < 60) {
+            AppendMessage(stream, NetMsgType::INV, 1 + 36 * (1 + rng.randrange(20)), rng);
+        } else if (kind < 98) {
+            AppendMessage(stream, NetMsgType::TX, 150 + rng.randrange(2000), rng);
+        } else {
+            AppendMessage(stream, NetMsgType::BLOCK, 50000 + rng.randrange(1000000), rng);
+        }
+    }
+    return stream;
+}
+
+/**
+ * Feed the stream to a node the way CConnman::SocketRecvData does, reading at
+ * most 64 KiB at a time and into the payload buffer where possible, and drop
+ * every message once it is complete as message processing would.
+ */
+static void ReplayStream(CNode& node, const std::vector<unsigned char>& stream)
+{
+    char pchBuf[0x10000];
+    size_t pos = 0;
+    while (pos < stream.size()) {
+        char* pch = pchBuf;
+        unsigned int nMaxBytes = sizeof(pchBuf);
+        if (char* pchWindow = node.GetRecvWindow(sizeof(pchBuf), nMaxBytes)) {
+            pch = pchWindow;
+        }
+        const unsigned int nBytes = std::min<size_t>(nMaxBytes, stream.size() - pos);
+        memcpy(pch, stream.data() + pos, nBytes);
+        pos += nBytes;
+
+        bool complete = false;
+        bool ok = node.ReceiveMsgBytes(pch, nBytes, complete);
+        assert(ok);
+        if (complete) {
+            node.MarkReceivedMsgsForProcessing(MAX_PROTOCOL_MESSAGE_LENGTH);
+            LOCK(node.cs_vProcessMsg);
+            for (const CNetMessage& msg : node.vProcessMsg) {
+                assert(memcmp(msg.GetMessageHash().begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+            }
+            node.vProcessMsg.clear();
+            node.nProcessQueueSize = 0;
+        }
+    }
+}
+
+static void NetRecvMessageStream(benchmark::State& state)
+{
+    const std::vector<unsigned char> stream = MakeMessageStream();
+    CAddress addr(CService(CNetAddr(), 0), NODE_NONE);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+
+    const CRecvBufferPool::Stats before = g_recv_buffer_pool.GetStats();
+    uint64_t replays = 0;
+    while (state.KeepRunning()) {
+        ReplayStream(node, stream);
+        replays++;
+    }
+    const CRecvBufferPool::Stats after = g_recv_buffer_pool.GetStats();
+
+    const double mb_received = double(stream.size()) * replays / 1000000;
+    tfm::format(std::cerr, "NetRecvMessageStream: %.3f buffer allocations per MB received (%u allocations, %u reuses, %.1f MB)\n",
+        (after.allocations - before.allocations) / mb_received,
+        after.allocations - before.allocations, after.reuses - before.reuses, mb_received);
+}
+
+BENCHMARK(NetRecvMessageStream, 5);
@@ -0,0 +1,118 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <script/sigcache.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** One cache behind one lock, as the signature cache was before it was sharded */
+class SingleLockCuckooCache
+{
+public:
+    size_t setup_bytes(size_t bytes) { return m_set.setup_bytes(bytes); }
+
+    bool contains(const uint256& entry, bool erase)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+        return m_set.contains(entry, erase);
+    }
+
+    void insert(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+        m_set.insert(entry);
+    }
+
+private:
+    CuckooCache::cache<uint256, SignatureCacheHasher> m_set;
+    boost::shared_mutex m_mutex;
+};
+
+/**
+ * Each thread looks up 9000 cached entries and adds 1000 new ones, the mix a
+ * block of mostly known transactions gives the script check threads. The
+ * time per run stays flat as threads are added only if they do not contend.
+ */
+template <typename Cache>
+static void SigCacheContention(benchmark::State& state, int num_threads)
+{
+    static constexpr size_t LOOKUPS_PER_THREAD = 9000;
+    static constexpr size_t INSERTS_PER_THREAD = 1000;
+
+    Cache cache;
+    cache.setup_bytes(DEFAULT_MAX_SIG_CACHE_SIZE / 2 << 20);
+    FastRandomContext rng(true);
+    std::vector<std::vector<uint256>> lookups(num_threads), inserts(num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        for (size_t i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+            lookups[t].push_back(rng.rand256());
+            cache.insert(lookups[t].back());
+        }
+        for (size_t i = 0; i < INSERTS_PER_THREAD; ++i) {
+            inserts[t].push_back(rng.rand256());
+        }
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    uint64_t run = 0;
+    int done = 0;
+    bool stop = false;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t] {
+            uint64_t last_run = 0;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cond.wait(lock, [&] { return stop || run != last_run; });
+                    if (stop) return;
+                    last_run = run;
+                }
+                for (size_t i = 0; i < LOOKUPS_PER_THREAD; ++i) {
+                    bool hit = cache.contains(lookups[t][i], false);
+                    assert(hit);
+                    if (i % (LOOKUPS_PER_THREAD / INSERTS_PER_THREAD) == 0) {
+                        cache.insert(inserts[t][i / (LOOKUPS_PER_THREAD / INSERTS_PER_THREAD)]);
+                    }
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                if (++done == num_threads) cond.notify_all();
+            }
+        });
+    }
+
+    while (state.KeepRunning()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done = 0;
+        ++run;
+        cond.notify_all();
+        cond.wait(lock, [&] { return done == num_threads; });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+        cond.notify_all();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+static void SigCacheContentionSingleLock1Thread(benchmark::State& state) { SigCacheContention<SingleLockCuckooCache>(state, 1); }
+static void SigCacheContentionSingleLock16Threads(benchmark::State& state) { SigCacheContention<SingleLockCuckooCache>(state, 16); }
+static void SigCacheContentionSharded1Thread(benchmark::State& state) { SigCacheContention<ShardedCuckooCache>(state, 1); }
+static void SigCacheContentionSharded4Threads(benchmark::State& state) { SigCacheContention<ShardedCuckooCache>(state, 4); }
+static void SigCacheContentionSharded16Threads(benchmark::State& state) { SigCacheContention<ShardedCuckooCache>(state, 16); }
+
+BENCHMARK(SigCacheContentionSingleLock1Thread, 500);
+BENCHMARK(SigCacheContentionSingleLock16Threads, 20);
+BENCHMARK(SigCacheContentionSharded1Thread, 500);
+BENCHMARK(SigCacheContentionSharded4Threads, 100);
+BENCHMARK(SigCacheContentionSharded16Threads, 20);
@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <node/txreconciliation.h>
+#include <random.h>
+#include <tinyformat.h>
+
+#include <cassert>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * Simulated network for comparing the bytes spent on transaction
+ * announcements with plain inv flooding and with reconciliation. Every
+ * simulated second each node announces what it learned the second before;
+ * getdata and tx messages cost the same either way and are not counted.
+ */
+static constexpr int SIM_NODES = 60;
+static constexpr int SIM_OUTBOUND = 8;
+static constexpr int SIM_SECONDS = 90;
+static constexpr int SIM_DRAIN_SECONDS = 30;
+static constexpr int SIM_TXS_PER_SECOND = 7;
+
+static constexpr size_t MSG_HEADER_SIZE = 24;
+static constexpr size_t INV_ENTRY_SIZE = 36;
+
+struct SimNode {
+    std::vector<int> peers;
+    std::vector<int> outbound;
+    std::unique_ptr<TxReconciliationTracker> tracker;
+    std::set<uint256> known;
+    //! transactions each peer is known to have, because either side announced it
+    std::map<int, std::set<uint256>> known_by_peer;
+    std::vector<uint256> to_announce;
+};
+
+struct SimAnnouncement {
+    int from;
+    int to;
+    std::vector<uint256> txids;
+};
+
+class SimNetwork
+{
+public:
+    SimNetwork(bool reconcile) : m_reconcile(reconcile), m_nodes(SIM_NODES)
+    {
+        FastRandomContext rng(true);
+        if (m_reconcile) {
+            for (SimNode& node : m_nodes) node.tracker.reset(new TxReconciliationTracker());
+        }
+        for (int i = 0; i < SIM_NODES; i++) {
+            while ((int)m_nodes[i].outbound.size() < SIM_OUTBOUND) {
+                const int j = rng.randrange(SIM_NODES);
+                if (j == i || m_nodes[i].known_by_peer.count(j)) continue;
+                Connect(i, j);
+            }
+        }
+    }
+
+    /** Run the simulation; returns the announcement bytes per transaction. */
+    double Run()
+    {
+        FastRandomContext rng(true);
+        int txs = 0;
+        for (int second = 0; second < SIM_SECONDS + SIM_DRAIN_SECONDS; second++) {
+            std::vector<SimAnnouncement> in_flight;
+            if (second < SIM_SECONDS) {
+                for (int i = 0; i < SIM_TXS_PER_SECOND; i++) {
+                    SimNode& origin = m_nodes[rng.randrange(SIM_NODES)];
+                    const uint256 txid = rng.rand256();
+                    origin.known.insert(txid);
+                    origin.to_announce.push_back(txid);
+                    txs++;
+                }
+            }
+            for (int i = 0; i < SIM_NODES; i++) Announce(i, in_flight);
+            if (m_reconcile) Reconcile(std::chrono::seconds{second}, in_flight);
+            for (const SimAnnouncement& announcement : in_flight) Deliver(announcement);
+        }
+        for (const SimNode& node : m_nodes) assert(node.known.size() == (size_t)txs);
+        return double(m_bytes) / txs;
+    }
+
+private:
+    const bool m_reconcile;
+    std::vector<SimNode> m_nodes;
+    uint64_t m_bytes{0};
+
+    void Connect(int from, int to)
+    {
+        m_nodes[from].peers.push_back(to);
+        m_nodes[from].outbound.push_back(to);
+        m_nodes[to].peers.push_back(from);
+        m_nodes[from].known_by_peer[to];
+        m_nodes[to].known_by_peer[from];
+        if (!m_reconcile) return;
+        const uint64_t from_salt = m_nodes[from].tracker->PreRegisterPeer(to);
+        const uint64_t to_salt = m_nodes[to].tracker->PreRegisterPeer(from);
+        m_nodes[from].tracker->RegisterPeer(to, false, TXRECONCILIATION_PROTOCOL_VERSION, to_salt);
+        m_nodes[to].tracker->RegisterPeer(from, true, TXRECONCILIATION_PROTOCOL_VERSION, from_salt);
+    }
+
+    void Send(int from, int to, std::vector<uint256> txids, std::vector<SimAnnouncement>& in_flight)
+    {
+        if (txids.empty()) return;
+        m_bytes += MSG_HEADER_SIZE + 1 + INV_ENTRY_SIZE * txids.size();
+        for (const uint256& txid : txids) m_nodes[from].known_by_peer[to].insert(txid);
+        in_flight.push_back(SimAnnouncement{from, to, std::move(txids)});
+    }
+
+    void Announce(int i, std::vector<SimAnnouncement>& in_flight)
+    {
+        SimNode& node = m_nodes[i];
+        for (int peer : node.peers) {
+            std::vector<uint256> inv;
+            for (const uint256& txid : node.to_announce) {
+                if (node.known_by_peer[peer].count(txid)) continue;
+                if (m_reconcile && node.tracker->AddToSet(peer, txid)) continue;
+                inv.push_back(txid);
+            }
+            Send(i, peer, std::move(inv), in_flight);
+        }
+        node.to_announce.clear();
+    }
+
+    void Reconcile(std::chrono::microseconds now, std::vector<SimAnnouncement>& in_flight)
+    {
+        for (int i = 0; i < SIM_NODES; i++) {
+            for (int j : m_nodes[i].outbound) {
+                TxReconciliationTracker& initiator = *m_nodes[i].tracker;
+                TxReconciliationTracker& responder = *m_nodes[j].tracker;
+                uint16_t set_size, q;
+                if (!initiator.InitiateReconciliationRequest(j, now, set_size, q)) continue;
+                m_bytes += MSG_HEADER_SIZE + 4;
+
+                std::vector<unsigned char> sketch;
+                bool ok = responder.HandleReconciliationRequest(i, set_size, q, sketch);
+                assert(ok);
+                m_bytes += MSG_HEADER_SIZE + 1 + sketch.size();
+
+                bool success;
+                std::vector<uint32_t> ask_shortids;
+                std::vector<uint256> announce;
+                ok = initiator.HandleSketch(j, sketch, success, ask_shortids, announce);
+                assert(ok);
+                Send(i, j, std::move(announce), in_flight);
+                m_bytes += MSG_HEADER_SIZE + 2 + 4 * ask_shortids.size();
+
+                ok = responder.HandleReconciliationDifference(i, success, ask_shortids, announce);
+                assert(ok);
+                Send(j, i, std::move(announce), in_flight);
+            }
+        }
+    }
+
+    void Deliver(const SimAnnouncement& announcement)
+    {
+        SimNode& node = m_nodes[announcement.to];
+        for (const uint256& txid : announcement.txids) {
+            node.known_by_peer[announcement.from].insert(txid);
+            if (m_reconcile) node.tracker->TryRemovingFromSet(announcement.from, txid);
+            if (node.known.insert(txid).second) node.to_announce.push_back(txid);
+        }
+    }
+};
+
+static void TxRelay(benchmark::State& state, bool reconcile)
+{
+    double bytes_per_tx = 0;
+    while (state.KeepRunning()) {
+        SimNetwork network(reconcile);
+        bytes_per_tx = network.Run();
+    }
+    tfm::format(std::cerr, "%s: %.0f announcement bytes per transaction (%d nodes, %d outbound connections each)\n",
+        reconcile ? "TxRelayReconcile" : "TxRelayFlood", bytes_per_tx, SIM_NODES, SIM_OUTBOUND);
+}
+
+static void TxRelayFlood(benchmark::State& state) { TxRelay(state, false); }
+static void TxRelayReconcile(benchmark::State& state) { TxRelay(state, true); }
+
+BENCHMARK(TxRelayFlood, 1);
+BENCHMARK(TxRelayReconcile, 1);
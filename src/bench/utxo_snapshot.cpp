@@ -0,0 +1,84 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <coins.h>
+#include <fs.h>
+#include <node/utxo_snapshot.h>
+#include <random.h>
+#include <script/script.h>
+#include <streams.h>
+#include <txdb.h>
+#include <version.h>
+
+#include <cassert>
+#include <memory>
+
+static const int SNAPSHOT_TXS = 50 * 1000;
+static const int SNAPSHOT_OUTPUTS_PER_TX = 4;
+
+static void FillCoinsDB(CCoinsViewDB& db)
+{
+    FastRandomContext rng(true);
+    CCoinsViewCache cache(&db);
+    for (int i = 0; i < SNAPSHOT_TXS; i++) {
+        const uint256 txid = rng.rand256();
+        for (int n = 0; n < SNAPSHOT_OUTPUTS_PER_TX; n++) {
+            CScript script;
+            script << OP_0 << rng.randbytes(20);
+            Coin coin(CTxOut(rng.randrange(100 * COIN), script), 100 + i, i == 0);
+            cache.AddCoin(COutPoint(txid, n), std::move(coin), false);
+        }
+    }
+    cache.SetBestBlock(rng.rand256());
+    assert(cache.Flush());
+}
+
+static void WriteSnapshot(CCoinsViewDB& db, const fs::path& path)
+{
+    std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+    CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    assert(WriteUTXOSnapshot(*cursor, file, metadata));
+    assert(metadata.m_coins_count == (uint64_t)SNAPSHOT_TXS * SNAPSHOT_OUTPUTS_PER_TX);
+}
+
+static void UTXOSnapshotWrite(benchmark::State& state)
+{
+    CCoinsViewDB db("", 8 << 20, true, false);
+    FillCoinsDB(db);
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    while (state.KeepRunning()) {
+        WriteSnapshot(db, path);
+    }
+    fs::remove(path);
+}
+
+static void UTXOSnapshotLoad(benchmark::State& state)
+{
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    {
+        CCoinsViewDB db("", 8 << 20, true, false);
+        FillCoinsDB(db);
+        WriteSnapshot(db, path);
+    }
+    while (state.KeepRunning()) {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata metadata;
+        file >> metadata;
+        CCoinsViewDB db("", 8 << 20, true, false);
+        CCoinsViewCache cache(&db);
+        cache.SetBestBlock(metadata.m_base_blockhash);
+        std::string error;
+        assert(ReadUTXOSnapshot(file, metadata, [&](const COutPoint& outpoint, Coin&& coin) {
+            cache.AddCoin(outpoint, std::move(coin), false);
+        }, error));
+        assert(cache.Flush());
+    }
+    fs::remove(path);
+}
+
+BENCHMARK(UTXOSnapshotWrite, 5);
+BENCHMARK(UTXOSnapshotLoad, 2);
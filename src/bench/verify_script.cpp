@@ -9,6 +9,7 @@
 #include <script/auroracoinconsensus.h>
 #endif
 #include <script/script.h>
+#include <script/sigcache.h>
 #include <script/standard.h>
 #include <streams.h>
 
@@ -49,11 +50,10 @@ static CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, co
     return txSpend;
 }
 
-// Microbenchmark for verification of a basic P2WPKH script. Can be easily
-// modified to measure performance of other types of scripts.
-static void VerifyScriptBench(benchmark::State& state)
+static void VerifyP2WPKH(benchmark::State& state, bool defer)
 {
-    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH;
+    // OP_CHECKSIG is only deferred when NULLFAIL makes a bad signature fail the script
+    const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH | (defer ? SCRIPT_VERIFY_NULLFAIL : 0);
     const int witnessversion = 0;
 
     // Keypair.
@@ -81,6 +81,26 @@ static void VerifyScriptBench(benchmark::State& state)
     witness.stack.push_back(ToByteVector(pubkey));
 
     // Benchmark.
+    if (defer) {
+        const CTransaction tx(txSpend);
+        PrecomputedTransactionData txdata(tx);
+        while (state.KeepRunning()) {
+            ScriptError err;
+            std::vector<DeferredSignature> deferred;
+            bool success = VerifyScript(
+                tx.vin[0].scriptSig,
+                txCredit.vout[0].scriptPubKey,
+                &tx.vin[0].scriptWitness,
+                flags,
+                CachingTransactionSignatureChecker(&tx, 0, txCredit.vout[0].nValue, /* store */ false, txdata, &deferred),
+                &err);
+            assert(err == SCRIPT_ERR_OK);
+            assert(success && deferred.size() == 1);
+            success = VerifyDeferredSignatures(deferred, /* store */ false);
+            assert(success);
+        }
+        return;
+    }
     while (state.KeepRunning()) {
         ScriptError err;
         bool success = VerifyScript(
@@ -106,4 +126,19 @@ static void VerifyScriptBench(benchmark::State& state)
     }
 }
 
+// Microbenchmark for verification of a basic P2WPKH script. Can be easily
+// modified to measure performance of other types of scripts.
+static void VerifyScriptBench(benchmark::State& state)
+{
+    VerifyP2WPKH(state, false);
+}
+
+// The same, with the signature deferred by CachingTransactionSignatureChecker
+// and verified after the script ran, as CScriptCheck does.
+static void VerifyScriptDeferredBench(benchmark::State& state)
+{
+    VerifyP2WPKH(state, true);
+}
+
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptDeferredBench, 6300);
@@ -45,6 +45,12 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const uint256& txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256& txhash0, const uint256& txhash1, const uint256& txhash2, const uint256& txhash3, uint64_t shortids[4]) const {
+    static_assert(SHORTTXIDS_LENGTH == 6, "shorttxids calculation assumes 6-byte shorttxids");
+    SipHashUint256x4(shorttxidk0, shorttxidk1, txhash0, txhash1, txhash2, txhash3, shortids);
+    for (int i = 0; i < 4; i++) shortids[i] &= 0xffffffffffffL;
+}
+
 
 
 ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& cmpctblock, const std::vector<std::pair<uint256, CTransactionRef>>& extra_txn) {
@@ -104,12 +110,35 @@ ReadStatus PartiallyDownloadedBlock::InitData(const CBlockHeaderAndShortTxIDs& c
     if (shorttxids.size() != cmpctblock.shorttxids.size())
         return READ_STATUS_FAILED; // Short ID collision
 
+    // Nearly all mempool transactions are not in the block. A bitmap of the
+    // short IDs, at least 16 bits per ID, turns most of them away without
+    // looking them up in the map.
+    uint64_t filter_bits = 1 << 12;
+    while (filter_bits < 16 * shorttxids.size()) filter_bits <<= 1;
+    const uint64_t filter_mask = filter_bits - 1;
+    std::vector<uint64_t> shortid_filter(filter_bits / 64);
+    for (const auto& shortid : shorttxids) {
+        shortid_filter[(shortid.first & filter_mask) >> 6] |= uint64_t{1} << (shortid.first & 63);
+    }
+
     std::vector<bool> have_txn(txn_available.size());
     {
     LOCK(pool->cs);
     const std::vector<std::pair<uint256, CTxMemPool::txiter> >& vTxHashes = pool->vTxHashes;
+    uint64_t batch[4];
     for (size_t i = 0; i < vTxHashes.size(); i++) {
-        uint64_t shortid = cmpctblock.GetShortID(vTxHashes[i].first);
+        // Short IDs are computed four at a time, as far as the mempool divides into fours
+        const size_t batch_start = i - i % 4;
+        uint64_t shortid;
+        if (batch_start + 4 <= vTxHashes.size()) {
+            if (i == batch_start) {
+                cmpctblock.GetShortIDs(vTxHashes[i].first, vTxHashes[i + 1].first, vTxHashes[i + 2].first, vTxHashes[i + 3].first, batch);
+            }
+            shortid = batch[i % 4];
+        } else {
+            shortid = cmpctblock.GetShortID(vTxHashes[i].first);
+        }
+        if (!(shortid_filter[(shortid & filter_mask) >> 6] & (uint64_t{1} << (shortid & 63)))) continue;
         std::unordered_map<uint64_t, uint16_t>::iterator idit = shorttxids.find(shortid);
         if (idit != shorttxids.end()) {
             if (!have_txn[idit->second]) {
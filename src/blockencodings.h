@@ -152,6 +152,8 @@ public:
     CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
 
     uint64_t GetShortID(const uint256& txhash) const;
+    /** GetShortID of four transactions at once, which is faster than one after another. */
+    void GetShortIDs(const uint256& txhash0, const uint256& txhash1, const uint256& txhash2, const uint256& txhash3, uint64_t shortids[4]) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
 
@@ -16,6 +16,8 @@
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <algorithm>
+#include <utility>
 #include <vector>
 
 /**
@@ -353,6 +355,59 @@ public:
     const CBlockIndex* GetAncestor(int height) const;
 };
 
+/**
+ * Owns CBlockIndex entries, which are constructed in place in large contiguous
+ * chunks instead of one heap allocation each. Entries never move once
+ * allocated, so pointers to them (BlockMap values, pprev, pskip) stay valid
+ * until Clear(). Entries allocated one after another end up adjacent in
+ * memory, which keeps pprev/pskip walks such as GetAncestor cache-friendly.
+ */
+class CBlockIndexArena
+{
+public:
+    //! Default number of entries per chunk
+    static const size_t CHUNK_SIZE = 4096;
+
+    CBlockIndexArena() = default;
+    CBlockIndexArena(const CBlockIndexArena&) = delete;
+    CBlockIndexArena& operator=(const CBlockIndexArena&) = delete;
+
+    template <typename... Args>
+    CBlockIndex* Allocate(Args&&... args)
+    {
+        if (m_chunks.empty() || m_chunks.back().size() == m_chunks.back().capacity()) {
+            m_chunks.emplace_back();
+            m_chunks.back().reserve(CHUNK_SIZE);
+        }
+        m_chunks.back().emplace_back(std::forward<Args>(args)...);
+        return &m_chunks.back().back();
+    }
+
+    //! Make sure the next n allocations are contiguous
+    void Reserve(size_t n)
+    {
+        if (!m_chunks.empty() && m_chunks.back().capacity() - m_chunks.back().size() >= n) return;
+        m_chunks.emplace_back();
+        m_chunks.back().reserve(std::max(n, CHUNK_SIZE));
+    }
+
+    //! Destroy all entries
+    void Clear() { m_chunks.clear(); }
+
+    size_t Size() const
+    {
+        size_t size = 0;
+        for (const std::vector<CBlockIndex>& chunk : m_chunks) size += chunk.size();
+        return size;
+    }
+
+    void swap(CBlockIndexArena& other) { m_chunks.swap(other.m_chunks); }
+
+private:
+    //! Chunks are never grown past their reserved capacity, so entries keep their address
+    std::vector<std::vector<CBlockIndex>> m_chunks;
+};
+
 arith_uint256 GetBlockProof(const CBlockIndex& block);
 
 /** Return the time it would take to redo the work difference between from and to, assuming the current hashrate corresponds to the difficulty at tip, in seconds. */
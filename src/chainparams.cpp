@@ -394,6 +394,8 @@ public:
         consensus.nTargetTimespan =  0.10 * 24 * 60 * 60; // 2.4 hours
         consensus.nTargetSpacing = 60; // 60 seconds
         consensus.nInterval = consensus.nTargetTimespan / consensus.nTargetSpacing;
+        consensus.nRuleChangeActivationThreshold = 108; // 75% for testchains
+        consensus.nMinerConfirmationWindow = 144; // Faster than normal for regtest (144 instead of 40320)
         consensus.nDiffChangeTarget = 67; // DigiShield Hard Fork Block BIP34Height 67,200
         consensus.BIP34Height = 500; // BIP34 activated on regtest (Used in functional tests for Bitcoin)
         consensus.BIP65Height = 1351; // BIP65 activated on regtest (Used in functional tests for Bitcoin)
@@ -425,6 +427,8 @@ public:
         consensus.multiAlgoDiffChangeTarget = 145; // Block 145,000 MultiAlgo Hard Fork
         consensus.workComputationChangeTarget = 1430; // Block 1,430,000 DigiSpeed Hard Fork
 
+        consensus.blockSequentialAlgoMaxCount = 5; // Maximum sequential blocks of same algo
+
         consensus.vDeployments[Consensus::DEPLOYMENT_TESTDUMMY].bit = 28;
         consensus.vDeployments[Consensus::DEPLOYMENT_TESTDUMMY].nStartTime = 0;
         consensus.vDeployments[Consensus::DEPLOYMENT_TESTDUMMY].nTimeout = Consensus::BIP9Deployment::NO_TIMEOUT;
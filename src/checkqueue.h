@@ -9,6 +9,8 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -26,12 +28,35 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every thread has a queue of its own. The master adds to its queue, and
+  * a thread without work steals half of another thread's queue, starting
+  * with the master's, so that work spreads over the threads without all
+  * of them taking the same lock for every batch.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    /**
+     * Checks held by one thread. The owner takes batches from the back, and
+     * other threads steal from the front.
+     */
+    struct WorkQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
+
+    //! Worker threads started beyond this many only take checks from the others
+    static const int MAX_QUEUES = 64;
+
+    //! Queue 0 is the master's; worker threads take the others in the order they start
+    WorkQueue queues[MAX_QUEUES];
+
+    //! Number of queues handed out, including the master's
+    std::atomic<int> nQueues{1};
+
+    //! Mutex to sleep and wake up threads with
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -40,87 +65,131 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Number of checks in any of the queues
+    std::atomic<unsigned int> nQueued{0};
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of workers that are idle.
+    std::atomic<int> nIdle{0};
 
     //! The total number of workers (including the master).
-    int nTotal;
+    std::atomic<int> nTotal{0};
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk{true};
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo{0};
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    /** Move a batch from the back of the own queue to vChecks. */
+    bool TakeOwn(WorkQueue& own, std::vector<T>& vChecks)
+    {
+        boost::unique_lock<boost::mutex> lock(own.mutex);
+        if (own.checks.empty()) return false;
+        // Decide how many work units to process now.
+        // * Do not try to do everything at once, but aim for increasingly smaller batches so
+        //   all workers finish approximately simultaneously.
+        // * Try to account for idle jobs which will instantly start helping.
+        // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)own.checks.size() / (nTotal + nIdle + 1)));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs from the queue to the local batch vector instead of copying.
+            vChecks[i].swap(own.checks.back());
+            own.checks.pop_back();
+        }
+        nQueued -= nNow;
+        return true;
+    }
+
+    /**
+     * Steal half of another thread's queue into the own one, or without one
+     * a batch straight into vChecks. Returns whether anything was taken.
+     */
+    bool Steal(int nOwn, WorkQueue* own, std::vector<T>& vChecks)
+    {
+        const int n = std::min(nQueues.load(), MAX_QUEUES);
+        std::vector<T> vStolen;
+        for (int i = 0; i < n; i++) {
+            const int nVictim = (nOwn + 1 + i) % n;
+            if (own && nVictim == nOwn) continue;
+            WorkQueue& victim = queues[nVictim];
+            {
+                boost::unique_lock<boost::mutex> lock(victim.mutex);
+                if (victim.checks.empty()) continue;
+                size_t nSteal = (victim.checks.size() + 1) / 2;
+                if (!own) nSteal = std::min<size_t>(nSteal, nBatchSize);
+                vStolen.resize(nSteal);
+                for (T& check : vStolen) {
+                    check.swap(victim.checks.front());
+                    victim.checks.pop_front();
+                }
+            }
+            if (!own) {
+                vChecks.swap(vStolen);
+                nQueued -= vChecks.size();
+                return true;
+            }
+            boost::unique_lock<boost::mutex> lock(own->mutex);
+            for (T& check : vStolen) {
+                own->checks.emplace_back();
+                check.swap(own->checks.back());
+            }
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        const int nOwn = fMaster ? 0 : nQueues++;
+        WorkQueue* own = nOwn < MAX_QUEUES ? &queues[nOwn] : nullptr;
+        nTotal++;
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if ((own && TakeOwn(*own, vChecks)) || Steal(nOwn, own, vChecks)) {
+                if (vChecks.empty()) continue; // stolen into the own queue
+                // execute work, unless some check already failed
+                bool fOk = fAllOk;
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk) fAllOk = false;
+                const unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow) == nNow) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                while (nQueued == 0 && nTodo != 0) {
+                    condMaster.wait(lock);
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                if (nTodo == 0) {
+                    nTotal--;
+                    // reset the status for new work later, returning the current one
+                    return fAllOk.exchange(true);
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+            } else {
+                // Announce being idle before looking at nQueued, as Add does the reverse
+                nIdle++;
+                while (nQueued == 0) {
+                    condWorker.wait(lock);
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+                nIdle--;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
@@ -129,7 +198,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -146,16 +215,23 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty()) return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        {
+            boost::unique_lock<boost::mutex> lock(queues[0].mutex);
+            for (T& check : vChecks) {
+                queues[0].checks.emplace_back();
+                check.swap(queues[0].checks.back());
+            }
+        }
+        nQueued += vChecks.size();
+        if (nIdle > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -94,6 +94,9 @@ typedef char* sockopt_arg_type;
 // __APPLE__ poll is broke https://github.com/bitcoin/bitcoin/pull/14336#issuecomment-437384408
 #if defined(__linux__)
 #define USE_POLL
+// Linux additionally gets a persistent, edge-triggered epoll registration per
+// socket so the socket handler does not rebuild its interest set every loop
+#define USE_EPOLL
 #endif
 
 bool static inline IsSelectableSocket(const SOCKET& s) {
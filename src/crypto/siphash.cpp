@@ -170,4 +170,66 @@ uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint3
     SIPROUND;
     SIPROUND;
     return v0 ^ v1 ^ v2 ^ v3;
-}
\ No newline at end of file
+}
+/* One SipHash state per value, in separate variables so they stay in registers */
+#define SIPROUND_STATE(v0, v1, v2, v3) do { \
+    v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; \
+    v0 = ROTL(v0, 32); \
+    v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; \
+    v2 = ROTL(v2, 32); \
+} while (0)
+
+#define SIPROUND4 do { \
+    SIPROUND_STATE(a0, a1, a2, a3); \
+    SIPROUND_STATE(b0, b1, b2, b3); \
+    SIPROUND_STATE(c0, c1, c2, c3); \
+    SIPROUND_STATE(e0, e1, e2, e3); \
+} while (0)
+
+#define SIPWORD4(word) do { \
+    a0 ^= da; da = val0.GetUint64(word); a3 ^= da; \
+    b0 ^= db; db = val1.GetUint64(word); b3 ^= db; \
+    c0 ^= dc; dc = val2.GetUint64(word); c3 ^= dc; \
+    e0 ^= de; de = val3.GetUint64(word); e3 ^= de; \
+} while (0)
+
+void SipHashUint256x4(uint64_t k0, uint64_t k1, const uint256& val0, const uint256& val1, const uint256& val2, const uint256& val3, uint64_t out[4])
+{
+    /* Four copies of SipHashUint256, interleaved */
+    uint64_t da = val0.GetUint64(0), db = val1.GetUint64(0), dc = val2.GetUint64(0), de = val3.GetUint64(0);
+
+    uint64_t a0 = 0x736f6d6570736575ULL ^ k0, b0 = a0, c0 = a0, e0 = a0;
+    uint64_t a1 = 0x646f72616e646f6dULL ^ k1, b1 = a1, c1 = a1, e1 = a1;
+    uint64_t a2 = 0x6c7967656e657261ULL ^ k0, b2 = a2, c2 = a2, e2 = a2;
+    const uint64_t init3 = 0x7465646279746573ULL ^ k1;
+    uint64_t a3 = init3 ^ da, b3 = init3 ^ db, c3 = init3 ^ dc, e3 = init3 ^ de;
+
+    SIPROUND4;
+    SIPROUND4;
+    SIPWORD4(1);
+    SIPROUND4;
+    SIPROUND4;
+    SIPWORD4(2);
+    SIPROUND4;
+    SIPROUND4;
+    SIPWORD4(3);
+    SIPROUND4;
+    SIPROUND4;
+    const uint64_t length = ((uint64_t)4) << 59;
+    a0 ^= da; b0 ^= db; c0 ^= dc; e0 ^= de;
+    a3 ^= length; b3 ^= length; c3 ^= length; e3 ^= length;
+    SIPROUND4;
+    SIPROUND4;
+    a0 ^= length; b0 ^= length; c0 ^= length; e0 ^= length;
+    a2 ^= 0xFF; b2 ^= 0xFF; c2 ^= 0xFF; e2 ^= 0xFF;
+    SIPROUND4;
+    SIPROUND4;
+    SIPROUND4;
+    SIPROUND4;
+    out[0] = a0 ^ a1 ^ a2 ^ a3;
+    out[1] = b0 ^ b1 ^ b2 ^ b3;
+    out[2] = c0 ^ c1 ^ c2 ^ c3;
+    out[3] = e0 ^ e1 ^ e2 ^ e3;
+}
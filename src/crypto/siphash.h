@@ -44,4 +44,7 @@ public:
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
 
+/** SipHashUint256 of four values at once, interleaved so their rounds can execute in parallel. */
+void SipHashUint256x4(uint64_t k0, uint64_t k1, const uint256& val0, const uint256& val1, const uint256& val2, const uint256& val3, uint64_t out[4]);
+
 #endif // AURORACOIN_CRYPTO_SIPHASH_H
\ No newline at end of file
@@ -222,18 +222,23 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
             return false;
         }
 
-        std::pair<uint256, DBVal> read_out;
-        if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
-            return false;
-        }
-
-        uint256 expected_block_hash = pindex->pprev->GetBlockHash();
-        if (read_out.first != expected_block_hash) {
-            return error("%s: previous block header belongs to unexpected block %s; expected %s",
-                         __func__, read_out.first.ToString(), expected_block_hash.ToString());
+        CachedEntry prev_entry;
+        if (LookupCachedEntry(pindex->pprev->GetBlockHash(), prev_entry)) {
+            prev_header = prev_entry.header;
+        } else {
+            std::pair<uint256, DBVal> read_out;
+            if (!m_db->Read(DBHeightKey(pindex->nHeight - 1), read_out)) {
+                return false;
+            }
+
+            uint256 expected_block_hash = pindex->pprev->GetBlockHash();
+            if (read_out.first != expected_block_hash) {
+                return error("%s: previous block header belongs to unexpected block %s; expected %s",
+                             __func__, read_out.first.ToString(), expected_block_hash.ToString());
+            }
+
+            prev_header = read_out.second.header;
         }
-
-        prev_header = read_out.second.header;
     }
 
     BlockFilter filter(m_filter_type, block, block_undo);
@@ -251,10 +256,50 @@ bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex
         return false;
     }
 
+    CacheEntry(value.first, CachedEntry{value.second.hash, value.second.header, value.second.pos});
     m_next_filter_pos.nPos += bytes_written;
     return true;
 }
 
+void BlockFilterIndex::CacheEntry(const uint256& block_hash, const CachedEntry& entry)
+{
+    LOCK(m_cs_cache);
+    // An entry never changes for a given block, as the filter header commits to its ancestors.
+    if (!m_recent_cache.emplace(block_hash, entry).second) return;
+    m_recent_order.push_back(block_hash);
+    if (m_recent_order.size() > FILTER_CACHE_BLOCKS) {
+        m_recent_cache.erase(m_recent_order.front());
+        m_recent_order.pop_front();
+    }
+}
+
+bool BlockFilterIndex::LookupCachedEntry(const uint256& block_hash, CachedEntry& entry) const
+{
+    LOCK(m_cs_cache);
+    auto it = m_recent_cache.find(block_hash);
+    if (it == m_recent_cache.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+bool BlockFilterIndex::LookupCachedRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<CachedEntry>& entries) const
+{
+    if (start_height < 0 || start_height > stop_index->nHeight) return false;
+    entries.resize(stop_index->nHeight - start_height + 1);
+
+    LOCK(m_cs_cache);
+    for (const CBlockIndex* block_index = stop_index;
+         block_index->nHeight >= start_height;
+         block_index = block_index->pprev) {
+        auto it = m_recent_cache.find(block_index->GetBlockHash());
+        if (it == m_recent_cache.end()) return false;
+        entries[block_index->nHeight - start_height] = it->second;
+        if (block_index->nHeight == start_height) break;
+    }
+    return true;
+}
+
 static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
                                        const std::string& index_name,
                                        int start_height, int stop_height)
@@ -379,6 +424,11 @@ static bool LookupRange(CDBWrapper& db, const std::string& index_name, int start
 
 bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
 {
+    CachedEntry cached;
+    if (LookupCachedEntry(block_index->GetBlockHash(), cached)) {
+        return ReadFilterFromDisk(cached.pos, filter_out);
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
@@ -389,11 +439,32 @@ bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter&
 
 bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
 {
+    CachedEntry cached;
+    if (LookupCachedEntry(block_index->GetBlockHash(), cached)) {
+        header_out = cached.header;
+        return true;
+    }
+
+    bool is_checkpoint = block_index->nHeight % CFCHECKPT_INTERVAL == 0;
+    if (is_checkpoint) {
+        LOCK(m_cs_cache);
+        auto header = m_checkpoint_cache.find(block_index->GetBlockHash());
+        if (header != m_checkpoint_cache.end()) {
+            header_out = header->second;
+            return true;
+        }
+    }
+
     DBVal entry;
     if (!LookupOne(*m_db, block_index, entry)) {
         return false;
     }
 
+    if (is_checkpoint) {
+        LOCK(m_cs_cache);
+        m_checkpoint_cache.emplace(block_index->GetBlockHash(), entry.header);
+    }
+
     header_out = entry.header;
     return true;
 }
@@ -401,15 +472,22 @@ bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint25
 bool BlockFilterIndex::LookupFilterRange(int start_height, const CBlockIndex* stop_index,
                                          std::vector<BlockFilter>& filters_out) const
 {
-    std::vector<DBVal> entries;
-    if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
-        return false;
+    std::vector<FlatFilePos> positions;
+    std::vector<CachedEntry> cached;
+    if (LookupCachedRange(start_height, stop_index, cached)) {
+        for (const auto& entry : cached) positions.push_back(entry.pos);
+    } else {
+        std::vector<DBVal> entries;
+        if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
+            return false;
+        }
+        for (const auto& entry : entries) positions.push_back(entry.pos);
     }
 
-    filters_out.resize(entries.size());
+    filters_out.resize(positions.size());
     auto filter_pos_it = filters_out.begin();
-    for (const auto& entry : entries) {
-        if (!ReadFilterFromDisk(entry.pos, *filter_pos_it)) {
+    for (const auto& pos : positions) {
+        if (!ReadFilterFromDisk(pos, *filter_pos_it)) {
             return false;
         }
         ++filter_pos_it;
@@ -422,6 +500,16 @@ bool BlockFilterIndex::LookupFilterHashRange(int start_height, const CBlockIndex
                                              std::vector<uint256>& hashes_out) const
 
 {
+    std::vector<CachedEntry> cached;
+    if (LookupCachedRange(start_height, stop_index, cached)) {
+        hashes_out.clear();
+        hashes_out.reserve(cached.size());
+        for (const auto& entry : cached) {
+            hashes_out.push_back(entry.filter_hash);
+        }
+        return true;
+    }
+
     std::vector<DBVal> entries;
     if (!LookupRange(*m_db, m_name, start_height, stop_index, entries)) {
         return false;
@@ -7,8 +7,24 @@
 
 #include <blockfilter.h>
 #include <chain.h>
+#include <crypto/common.h>
 #include <flatfile.h>
 #include <index/base.h>
+#include <sync.h>
+
+#include <deque>
+#include <unordered_map>
+
+/** Interval between compact filter checkpoints. See BIP 157. */
+static constexpr int CFCHECKPT_INTERVAL = 1000;
+
+/** Number of most recently indexed blocks whose filter hashes and headers are kept in memory. */
+static constexpr size_t FILTER_CACHE_BLOCKS = 10000;
+
+struct FilterHeaderHasher
+{
+    size_t operator()(const uint256& hash) const { return ReadLE64(hash.begin()); }
+};
 
 /**
  * BlockFilterIndex is used to store and retrieve block filters, hashes, and headers for a range of
@@ -27,9 +43,29 @@ private:
     FlatFilePos m_next_filter_pos;
     std::unique_ptr<FlatFileSeq> m_filter_fileseq;
 
+    /** What the database holds for a block, kept in memory for recent blocks. */
+    struct CachedEntry {
+        uint256 filter_hash;
+        uint256 header;
+        FlatFilePos pos;
+    };
+
+    mutable Mutex m_cs_cache;
+    /** Recently indexed blocks by block hash, which is what light clients following the tip ask for. */
+    std::unordered_map<uint256, CachedEntry, FilterHeaderHasher> m_recent_cache GUARDED_BY(m_cs_cache);
+    /** Block hashes in m_recent_cache, oldest first. */
+    std::deque<uint256> m_recent_order GUARDED_BY(m_cs_cache);
+    /** Filter headers of checkpoint blocks, which every light client asks for. */
+    mutable std::unordered_map<uint256, uint256, FilterHeaderHasher> m_checkpoint_cache GUARDED_BY(m_cs_cache);
+
     bool ReadFilterFromDisk(const FlatFilePos& pos, BlockFilter& filter) const;
     size_t WriteFilterToDisk(FlatFilePos& pos, const BlockFilter& filter);
 
+    void CacheEntry(const uint256& block_hash, const CachedEntry& entry);
+    bool LookupCachedEntry(const uint256& block_hash, CachedEntry& entry) const;
+    /** Entries for a range of blocks if all of them are cached. */
+    bool LookupCachedRange(int start_height, const CBlockIndex* stop_index, std::vector<CachedEntry>& entries) const;
+
 protected:
     bool Init() override;
 
@@ -85,6 +85,9 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+
+    fBlockFull = false;
+    lowestPackageFeeRate = CFeeRate(MAX_MONEY);
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
@@ -139,9 +142,29 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    int nChunksSelected = 0;
+    BlockTemplateSelection selection;
+    bool fNeedsFill = true;
+    if (g_block_candidate && g_block_candidate->Get(pindexPrev, nBlockMaxWeight, blockMinFeeRate, fIncludeWitness, selection, fNeedsFill) &&
+            addSelectedTxs(selection)) {
+        fBlockFull = selection.fFull;
+        lowestPackageFeeRate = selection.lowestPackageFeeRate;
+    } else {
+        fNeedsFill = true;
+    }
+    if (fNeedsFill) {
+        fBlockFull = false;
+        addChunkTxs(nChunksSelected);
+    }
+    if (g_block_candidate) {
+        selection.vtx.assign(pblock->vtx.begin() + 1, pblock->vtx.end());
+        selection.vTxSigOpsCost.assign(pblocktemplate->vTxSigOpsCost.begin() + 1, pblocktemplate->vTxSigOpsCost.end());
+        selection.nBlockWeight = nBlockWeight;
+        selection.nBlockSigOpsCost = nBlockSigOpsCost;
+        selection.fFull = fBlockFull;
+        selection.lowestPackageFeeRate = lowestPackageFeeRate;
+        g_block_candidate->Set(pindexPrev, nBlockMaxWeight, blockMinFeeRate, fIncludeWitness, std::move(selection));
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -175,24 +198,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() chunks: %.2fms (%d chunks%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nChunksSelected, fNeedsFill ? "" : ", kept selection", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
-{
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
-        }
-    }
-}
-
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
@@ -207,7 +217,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 // - transaction finality (locktime)
 // - premature witness (in case segwit transactions are added to mempool before
 //   segwit activation)
-bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+bool BlockAssembler::TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package)
 {
     for (CTxMemPool::txiter it : package) {
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
@@ -237,83 +247,30 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-        indexed_modified_transaction_set &mapModifiedTx)
+// This transaction selection algorithm takes the chunks of the mempool's
+// clusters best feerate first. The chunks of each cluster already come in
+// decreasing feerate order, so only the next chunk of every cluster has to be
+// compared, and a chunk's feerate never changes as others are selected: its
+// in-mempool ancestors are all in earlier chunks of the same cluster. Once a
+// chunk is left out, the rest of its cluster is too, as it may depend on it.
+void BlockAssembler::addChunkTxs(int &nChunksSelected)
 {
-    int nDescendantsUpdated = 0;
-    for (CTxMemPool::txiter it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendants(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set
-        for (CTxMemPool::txiter desc : descendants) {
-            if (alreadyAdded.count(desc))
-                continue;
-            ++nDescendantsUpdated;
-            modtxiter mit = mapModifiedTx.find(desc);
-            if (mit == mapModifiedTx.end()) {
-                CTxMemPoolModifiedEntry modEntry(desc);
-                modEntry.nSizeWithAncestors -= it->GetTxSize();
-                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-                modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
-                mapModifiedTx.insert(modEntry);
-            } else {
-                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
-            }
+    struct NextChunk {
+        const CTxMemPool::Cluster* cluster;
+        size_t index;
+
+        const CTxMemPool::Chunk& Get() const { return cluster->chunks[index]; }
+        bool operator<(const NextChunk& other) const
+        {
+            return (double)Get().fee * other.Get().size < (double)other.Get().fee * Get().size;
         }
+    };
+    std::vector<NextChunk> heads;
+    heads.reserve(mempool.GetClusters().size());
+    for (const auto& entry : mempool.GetClusters()) {
+        heads.push_back(NextChunk{&entry.second, 0});
     }
-    return nDescendantsUpdated;
-}
-
-// Skip entries in mapTx that are already in a block or are present
-// in mapModifiedTx (which implies that the mapTx ancestor state is
-// stale due to ancestor inclusion in the block)
-// Also skip transactions that we've already failed to add. This can happen if
-// we consider a transaction in mapModifiedTx and it fails: we can then
-// potentially consider it again while walking mapTx.  It's currently
-// guaranteed to fail again, but as a belt-and-suspenders check we put it in
-// failedTx and avoid re-evaluation, since the re-evaluation would be using
-// cached size/sigops/fee values that are not actually correct.
-bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
-{
-    assert (it != mempool.mapTx.end());
-    return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
-}
-
-void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
-{
-    // Sort package by ancestor count
-    // If a transaction A depends on transaction B, then A's ancestor count
-    // must be greater than B's.  So this is sufficient to validly order the
-    // transactions for block inclusion.
-    sortedEntries.clear();
-    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
-}
-
-// This transaction selection algorithm orders the mempool based
-// on feerate of a transaction including all unconfirmed ancestors.
-// Since we don't remove transactions from the mempool as we select them
-// for block inclusion, we need an alternate method of updating the feerate
-// of a transaction with its not-yet-selected ancestors as we go.
-// This is accomplished by walking the in-mempool descendants of selected
-// transactions and storing a temporary modified state in mapModifiedTxs.
-// Each time through the loop, we compare the best transaction in
-// mapModifiedTxs with the next transaction in the mempool to decide what
-// transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
-{
-    // mapModifiedTx will store sorted packages after they are modified
-    // because some of their txs are already in the block
-    indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work
-    CTxMemPool::setEntries failedTx;
-
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
-    CTxMemPool::txiter iter;
+    std::priority_queue<NextChunk> queue(std::less<NextChunk>(), std::move(heads));
 
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
@@ -321,113 +278,246 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
-    {
-        // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
-            continue;
-        }
+    std::vector<CTxMemPool::txiter> package;
+    while (!queue.empty()) {
+        const NextChunk next = queue.top();
+        queue.pop();
+        const CTxMemPool::Chunk& chunk = next.Get();
 
-        // Now that mi is not stale, determine which transaction to evaluate:
-        // the next entry from mapTx, or the best from mapModifiedTx?
-        bool fUsingModified = false;
-
-        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-            // We're out of entries in mapTx; use the entry from mapModifiedTx
-            iter = modit->iter;
-            fUsingModified = true;
-        } else {
-            // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
-            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-                    CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter))) {
-                // The best entry in mapModifiedTx has higher score
-                // than the one from mapTx.
-                // Switch which transaction (package) to consider
-                iter = modit->iter;
-                fUsingModified = true;
-            } else {
-                // Either no entry in mapModifiedTx, or it's worse than mapTx.
-                // Increment mi for the next loop iteration.
-                ++mi;
-            }
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
+            // Everything else we might consider has a lower fee rate
+            return;
         }
 
-        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-        // contain anything that is inBlock.
-        assert(!inBlock.count(iter));
-
-        uint64_t packageSize = iter->GetSizeWithAncestors();
-        CAmount packageFees = iter->GetModFeesWithAncestors();
-        int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
-        if (fUsingModified) {
-            packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
-            packageSigOpsCost = modit->nSigOpCostWithAncestors;
+        // Leave out what a kept selection has already put in the block
+        package.clear();
+        uint64_t packageSize = 0;
+        CAmount packageFees = 0;
+        int64_t packageSigOpsCost = 0;
+        for (size_t i = next.index > 0 ? next.cluster->chunks[next.index - 1].end : 0; i < chunk.end; ++i) {
+            CTxMemPool::txiter it = next.cluster->linearization[i];
+            if (inBlock.count(it)) continue;
+            package.push_back(it);
+            packageSize += it->GetTxSize();
+            packageFees += it->GetModifiedFee();
+            packageSigOpsCost += it->GetSigOpCost();
         }
 
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
-            // Everything else we might consider has a lower fee rate
-            return;
-        }
+        if (!package.empty()) {
+            if (packageFees < blockMinFeeRate.GetFee(packageSize)) continue;
 
-        if (!TestPackage(packageSize, packageSigOpsCost)) {
-            if (fUsingModified) {
-                // Since we always look at the best entry in mapModifiedTx,
-                // we must erase failed entries so that we can consider the
-                // next best entry on the next loop iteration
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
+            if (!TestPackage(packageSize, packageSigOpsCost)) {
+                fBlockFull = true;
+                ++nConsecutiveFailed;
+
+                if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                        nBlockMaxWeight - 4000) {
+                    // Give up if we're close to full and haven't succeeded in a while
+                    break;
+                }
+                continue;
             }
 
-            ++nConsecutiveFailed;
+            // Test if all tx's are Final
+            if (!TestPackageTransactions(package)) continue;
+
+            // This chunk will make it in; reset the failed counter.
+            nConsecutiveFailed = 0;
 
-            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
-                    nBlockMaxWeight - 4000) {
-                // Give up if we're close to full and haven't succeeded in a while
-                break;
+            // The linearization is a valid order for the block
+            for (CTxMemPool::txiter it : package) {
+                AddToBlock(it);
             }
-            continue;
+            ++nChunksSelected;
+            lowestPackageFeeRate = std::min(lowestPackageFeeRate, CFeeRate(packageFees, packageSize));
+        }
+
+        if (next.index + 1 < next.cluster->chunks.size()) {
+            queue.push(NextChunk{next.cluster, next.index + 1});
         }
+    }
+}
+
+bool BlockAssembler::addSelectedTxs(const BlockTemplateSelection& selection)
+{
+    std::vector<CTxMemPool::txiter> entries;
+    entries.reserve(selection.vtx.size());
+    for (const CTransactionRef& tx : selection.vtx) {
+        CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+        if (it == mempool.mapTx.end()) return false;
+        entries.push_back(it);
+    }
+    for (CTxMemPool::txiter it : entries) {
+        AddToBlock(it);
+    }
+    return true;
+}
 
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+std::unique_ptr<BlockTemplateCandidate> g_block_candidate;
 
-        onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
+bool BlockTemplateCandidate::Get(const CBlockIndex* tip, uint64_t max_weight, const CFeeRate& min_fee_rate, bool include_witness, BlockTemplateSelection& selection, bool& needs_fill) const
+{
+    LOCK(m_mutex);
+    if (m_tip == nullptr || m_tip != tip || m_max_weight != max_weight || m_min_fee_rate != min_fee_rate || m_include_witness != include_witness) {
+        return false;
+    }
+    selection = m_selection;
+    needs_fill = m_needs_fill;
+    return true;
+}
 
-        // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
-            if (fUsingModified) {
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+void BlockTemplateCandidate::Set(const CBlockIndex* tip, uint64_t max_weight, const CFeeRate& min_fee_rate, bool include_witness, BlockTemplateSelection selection)
+{
+    LOCK(m_mutex);
+    m_tip = tip;
+    m_max_weight = max_weight;
+    m_min_fee_rate = min_fee_rate;
+    m_include_witness = include_witness;
+    m_selected.clear();
+    for (const CTransactionRef& tx : selection.vtx) {
+        m_selected.insert(tx->GetHash());
+    }
+    m_selection = std::move(selection);
+    m_needs_fill = false;
+    m_active = true;
+}
+
+void BlockTemplateCandidate::Invalidate()
+{
+    LOCK(m_mutex);
+    InvalidateLocked();
+}
+
+void BlockTemplateCandidate::InvalidateLocked()
+{
+    m_active = false;
+    m_tip = nullptr;
+    m_selection = BlockTemplateSelection();
+    m_selected.clear();
+}
+
+void BlockTemplateCandidate::TransactionAddedToMempool(const CTransactionRef& tx)
+{
+    if (!m_active) return;
+
+    LOCK2(cs_main, mempool.cs);
+    LOCK(m_mutex);
+    if (m_tip == nullptr || m_selected.count(tx->GetHash())) return;
+    if (m_tip != ::ChainActive().Tip()) {
+        // The new tip has yet to be seen here; top up the selection once it has
+        m_needs_fill = true;
+        return;
+    }
+    CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+    if (it == mempool.mapTx.end()) return;
+
+    // The package is the transaction with its ancestors not picked yet
+    CTxMemPool::setEntries package;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    mempool.CalculateMemPoolAncestors(*it, package, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+    package.insert(it);
+    uint64_t package_size = 0;
+    uint64_t package_weight = 0;
+    CAmount package_fees = 0;
+    int64_t package_sigops = 0;
+    const int nHeight = m_tip->nHeight + 1;
+    const int64_t nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? m_tip->GetMedianTimePast() : GetAdjustedTime();
+    for (CTxMemPool::setEntries::iterator pit = package.begin(); pit != package.end(); ) {
+        if (m_selected.count((*pit)->GetTx().GetHash())) {
+            pit = package.erase(pit);
             continue;
         }
+        if (!IsFinalTx((*pit)->GetTx(), nHeight, nLockTimeCutoff) || (!m_include_witness && (*pit)->GetTx().HasWitness())) {
+            // Never picked until the tip changes; the same holds for a full selection
+            return;
+        }
+        package_size += (*pit)->GetTxSize();
+        package_weight += (*pit)->GetTxWeight();
+        package_fees += (*pit)->GetModifiedFee();
+        package_sigops += (*pit)->GetSigOpCost();
+        ++pit;
+    }
+    if (package_fees < m_min_fee_rate.GetFee(package_size)) return;
+
+    BlockTemplateSelection& selection = m_selection;
+    if (selection.nBlockWeight + WITNESS_SCALE_FACTOR * package_size >= m_max_weight ||
+            selection.nBlockSigOpsCost + package_sigops >= MAX_BLOCK_SIGOPS_COST) {
+        selection.fFull = true;
+        // A full selection would take this package before some that were picked
+        if (CFeeRate(package_fees, package_size) > selection.lowestPackageFeeRate) InvalidateLocked();
+        return;
+    }
 
-        // This transaction will make it in; reset the failed counter.
-        nConsecutiveFailed = 0;
+    std::vector<CTxMemPool::txiter> sorted(package.begin(), package.end());
+    std::sort(sorted.begin(), sorted.end(), CompareTxIterByAncestorCount());
+    for (CTxMemPool::txiter entry : sorted) {
+        selection.vtx.push_back(entry->GetSharedTx());
+        selection.vTxSigOpsCost.push_back(entry->GetSigOpCost());
+        m_selected.insert(entry->GetTx().GetHash());
+    }
+    selection.nBlockWeight += package_weight;
+    selection.nBlockSigOpsCost += package_sigops;
+    selection.lowestPackageFeeRate = std::min(selection.lowestPackageFeeRate, CFeeRate(package_fees, package_size));
+}
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, sortedEntries);
+void BlockTemplateCandidate::TransactionRemovedFromMempool(const CTransactionRef& tx)
+{
+    if (!m_active) return;
 
-        for (size_t i=0; i<sortedEntries.size(); ++i) {
-            AddToBlock(sortedEntries[i]);
-            // Erase from the modified set, if present
-            mapModifiedTx.erase(sortedEntries[i]);
-        }
+    LOCK(m_mutex);
+    if (m_selected.count(tx->GetHash())) InvalidateLocked();
+}
 
-        ++nPackagesSelected;
+void BlockTemplateCandidate::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (!m_active) return;
+
+    LOCK(cs_main);
+    LOCK(m_mutex);
+    if (m_tip == nullptr) return;
+    // The selection was made after this block was connected
+    if (m_tip->GetAncestor(pindex->nHeight) == pindex) return;
+    if (pindex->pprev != m_tip) {
+        InvalidateLocked();
+        return;
+    }
+    for (const CTransactionRef& tx : txnConflicted) {
+        if (m_selected.count(tx->GetHash())) {
+            InvalidateLocked();
+            return;
+        }
+    }
 
-        // Update transactions that depend on each of these
-        nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
+    // Drop the transactions that were mined; what is left keeps a valid order
+    std::unordered_set<uint256, SaltedTxidHasher> mined;
+    for (const CTransactionRef& tx : block->vtx) {
+        if (m_selected.erase(tx->GetHash())) mined.insert(tx->GetHash());
     }
+    BlockTemplateSelection& selection = m_selection;
+    size_t kept = 0;
+    for (size_t i = 0; i < selection.vtx.size(); i++) {
+        if (mined.count(selection.vtx[i]->GetHash())) {
+            selection.nBlockWeight -= GetTransactionWeight(*selection.vtx[i]);
+            selection.nBlockSigOpsCost -= selection.vTxSigOpsCost[i];
+            continue;
+        }
+        selection.vtx[kept] = std::move(selection.vtx[i]);
+        selection.vTxSigOpsCost[kept] = selection.vTxSigOpsCost[i];
+        ++kept;
+    }
+    selection.vtx.resize(kept);
+    selection.vTxSigOpsCost.resize(kept);
+    m_tip = pindex;
+    if (!mined.empty() && selection.fFull) m_needs_fill = true;
+}
+
+void BlockTemplateCandidate::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (!m_active) return;
+
+    LOCK(m_mutex);
+    InvalidateLocked();
 }
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
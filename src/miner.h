@@ -12,12 +12,12 @@
 #include <primitives/block.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
+#include <atomic>
 #include <memory>
 #include <stdint.h>
-
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
+#include <unordered_set>
 
 class CBlockIndex;
 class CChainParams;
@@ -35,49 +35,6 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
-// Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-struct CTxMemPoolModifiedEntry {
-    explicit CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
-    {
-        iter = entry;
-        nSizeWithAncestors = entry->GetSizeWithAncestors();
-        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-        nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
-    }
-
-    int64_t GetModifiedFee() const { return iter->GetModifiedFee(); }
-    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
-    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
-    size_t GetTxSize() const { return iter->GetTxSize(); }
-    const CTransaction& GetTx() const { return iter->GetTx(); }
-
-    CTxMemPool::txiter iter;
-    uint64_t nSizeWithAncestors;
-    CAmount nModFeesWithAncestors;
-    int64_t nSigOpCostWithAncestors;
-};
-
-/** Comparator for CTxMemPool::txiter objects.
- *  It simply compares the internal memory address of the CTxMemPoolEntry object
- *  pointed to. This means it has no meaning, and is only useful for using them
- *  as key in other indexes.
- */
-struct CompareCTxMemPoolIter {
-    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct modifiedentry_iter {
-    typedef CTxMemPool::txiter result_type;
-    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
-    {
-        return entry.iter;
-    }
-};
-
 // A comparator that sorts transactions based on number of ancestors.
 // This is sufficient to sort an ancestor package in an order that is valid
 // to appear in a block.
@@ -90,40 +47,23 @@ struct CompareTxIterByAncestorCount {
     }
 };
 
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<
-            modifiedentry_iter,
-            CompareCTxMemPoolIter
-        >,
-        // sorted by modified ancestor fee rate
-        boost::multi_index::ordered_non_unique<
-            // Reuse same tag from CTxMemPool's similar index
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareTxMemPoolEntryByAncestorFee
-        >
-    >
-> indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
-
-struct update_for_parent_inclusion
+/** The transactions picked for a block template, and how the picking ended. */
+struct BlockTemplateSelection
 {
-    explicit update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-    void operator() (CTxMemPoolModifiedEntry &e)
-    {
-        e.nModFeesWithAncestors -= iter->GetFee();
-        e.nSizeWithAncestors -= iter->GetTxSize();
-        e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
-    }
-
-    CTxMemPool::txiter iter;
+    //! transactions in block order, without the coinbase
+    std::vector<CTransactionRef> vtx;
+    std::vector<int64_t> vTxSigOpsCost;
+    //! weight and sigops cost including what is reserved for the coinbase
+    uint64_t nBlockWeight{0};
+    int64_t nBlockSigOpsCost{0};
+    //! whether a package was left out for lack of space
+    bool fFull{false};
+    //! lowest feerate among the chunks and packages picked
+    CFeeRate lowestPackageFeeRate{MAX_MONEY};
 };
 
+class BlockTemplateCandidate;
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
@@ -144,6 +84,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    bool fBlockFull;
+    CFeeRate lowestPackageFeeRate;
 
     // Chain context for the block
     int nHeight;
@@ -174,32 +116,81 @@ private:
     void AddToBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
-    /** Add transactions based on feerate including unconfirmed ancestors
-      * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
-
-    // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
+    /** Add the chunks of the mempool's clusters, best feerate first.
+      * Increments nChunksSelected (for logging statistics). */
+    void addChunkTxs(int &nChunksSelected) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add the transactions of a selection kept by BlockTemplateCandidate.
+      * Returns false, adding nothing, if any of them has left the mempool. */
+    bool addSelectedTxs(const BlockTemplateSelection& selection) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+
+    // helper functions for addChunkTxs()
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
-    bool TestPackageTransactions(const CTxMemPool::setEntries& package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-      * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
-    /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-      * state updated assuming given transactions are inBlock. Returns number
-      * of updated descendants. */
-    int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    bool TestPackageTransactions(const std::vector<CTxMemPool::txiter>& package);
 };
 
+/**
+ * Keeps the transaction selection of the next block up to date as the mempool
+ * and the chain change, so that a template does not need a walk over the
+ * whole mempool every time it is refreshed.
+ *
+ * The selection addChunkTxs makes for a template is kept here. A
+ * transaction entering the mempool afterwards is appended to it, with its
+ * ancestors not picked yet, if the package fits and pays the minimum
+ * feerate. Transactions in a block connected on top of the selection's tip
+ * are dropped from it, and if packages had been left out for lack of space,
+ * the next template tops it up with addChunkTxs. Whenever a full selection
+ * could differ from the kept one in another way (a picked transaction left
+ * the mempool, a better package does not fit, a block was disconnected,
+ * fees were prioritised) the selection is dropped and the next template
+ * selects from scratch.
+ *
+ * Events arrive after the fact, so a selection is only used if all of its
+ * transactions are still in the mempool; the block is checked with
+ * TestBlockValidity as always.
+ */
+class BlockTemplateCandidate final : public CValidationInterface
+{
+public:
+    /** The selection for a block on tip assembled with these limits, if one is kept. */
+    bool Get(const CBlockIndex* tip, uint64_t max_weight, const CFeeRate& min_fee_rate, bool include_witness, BlockTemplateSelection& selection, bool& needs_fill) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs);
+    /** Keep the selection a template on tip was assembled with. */
+    void Set(const CBlockIndex* tip, uint64_t max_weight, const CFeeRate& min_fee_rate, bool include_witness, BlockTemplateSelection selection)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs);
+    /** Drop the kept selection. */
+    void Invalidate();
+
+protected:
+    void TransactionAddedToMempool(const CTransactionRef& tx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& tx) override;
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+private:
+    void InvalidateLocked() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    mutable Mutex m_mutex;
+    //! whether a selection is kept, readable without taking the locks
+    std::atomic<bool> m_active{false};
+    //! tip the selection is for, null if none is kept
+    const CBlockIndex* m_tip GUARDED_BY(m_mutex){nullptr};
+    uint64_t m_max_weight GUARDED_BY(m_mutex){0};
+    CFeeRate m_min_fee_rate GUARDED_BY(m_mutex);
+    bool m_include_witness GUARDED_BY(m_mutex){false};
+    BlockTemplateSelection m_selection GUARDED_BY(m_mutex);
+    std::unordered_set<uint256, SaltedTxidHasher> m_selected GUARDED_BY(m_mutex);
+    //! whether block space was freed since packages were left out
+    bool m_needs_fill GUARDED_BY(m_mutex){false};
+};
+
+/** Kept up to date while the node runs; null if templates are always assembled from scratch. */
+extern std::unique_ptr<BlockTemplateCandidate> g_block_candidate;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev, int algo);
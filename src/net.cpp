@@ -29,12 +29,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -68,6 +73,11 @@ static constexpr int DNSSEEDS_TO_QUERY_AT_ONCE = 3;
 #define MSG_DONTWAIT 0
 #endif
 
+// MSG_MORE is Linux-only; elsewhere queued messages are still coalesced, just not corked
+#if !defined(MSG_MORE)
+#define MSG_MORE 0
+#endif
+
 /** Used to pass flags to the Bind() function */
 enum BindFlags {
     BF_NONE         = 0,
@@ -79,6 +89,19 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+#ifndef WIN32
+// Maximum number of queued send buffers passed to a single sendmsg() call
+static const size_t MAX_SEND_IOV = 64;
+#endif
+
+#ifdef USE_EPOLL
+// Maximum number of events collected by a single epoll_wait() call
+static const int EPOLL_MAX_EVENTS = 1024;
+// Set in an epoll event's data for listening sockets; the low bits hold the
+// index into vhListenSocket. Node events carry the (non-negative) NodeId.
+static constexpr uint64_t EPOLL_LISTEN_TAG = uint64_t{1} << 63;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -577,7 +600,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -616,6 +639,35 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+void CNode::MarkReceivedMsgsForProcessing(unsigned int nRecvFloodSize)
+{
+    size_t nSizeAdded = 0;
+    auto it(vRecvMsg.begin());
+    for (; it != vRecvMsg.end(); ++it) {
+        if (!it->complete())
+            break;
+        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    }
+    LOCK(cs_vProcessMsg);
+    vProcessMsg.splice(vProcessMsg.end(), vRecvMsg, vRecvMsg.begin(), it);
+    nProcessQueueSize += nSizeAdded;
+    fPauseRecv = nProcessQueueSize > nRecvFloodSize;
+}
+
+char* CNode::GetRecvWindow(unsigned int nMin, unsigned int& nBytes)
+{
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data || vRecvMsg.back().complete())
+        return nullptr;
+    CNetMessage& msg = vRecvMsg.back();
+    unsigned int nRemaining = msg.hdr.nMessageSize - msg.nDataPos;
+    if (nRemaining < nMin)
+        return nullptr;
+    msg.PrepareData(nMin);
+    nBytes = msg.vRecv.size() - msg.nDataPos;
+    return &msg.vRecv[msg.nDataPos];
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -679,18 +731,94 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
+    PrepareData(nCopy);
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Data read through CNode::GetRecvWindow is already in place
+    if (pch != &vRecv[nDataPos])
+        memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+void CNetMessage::PrepareData(unsigned int nBytes)
+{
+    if (vRecv.size() >= nDataPos + nBytes)
+        return;
+
+    // Allocate up to 256 KiB ahead, but never more than the total message size.
+    unsigned int nWanted = std::min(hdr.nMessageSize, nDataPos + nBytes + 256 * 1024);
+    if (vRecv.capacity() < nWanted) {
+        CSerializeData buf = g_recv_buffer_pool.Acquire(nWanted);
+        buf.assign(vRecv.begin(), vRecv.begin() + nDataPos);
+        vRecv.swap(buf);
+        g_recv_buffer_pool.Release(std::move(buf));
+    }
+    // The capacity is allocated already, so use all of it that the message needs.
+    vRecv.resize(std::min<size_t>(hdr.nMessageSize, vRecv.capacity()));
+}
+
+CNetMessage::~CNetMessage()
+{
+    CSerializeData buf;
+    vRecv.swap(buf);
+    g_recv_buffer_pool.Release(std::move(buf));
+}
+
+constexpr size_t CRecvBufferPool::CLASS_SIZE[];
+constexpr size_t CRecvBufferPool::CLASS_MAX_FREE[];
+
+CRecvBufferPool g_recv_buffer_pool;
+
+CSerializeData CRecvBufferPool::Acquire(size_t nSize)
+{
+    CSerializeData buf;
+    size_t cls = 0;
+    while (cls < NUM_CLASSES && CLASS_SIZE[cls] < nSize)
+        cls++;
+    if (cls < NUM_CLASSES) {
+        LOCK(cs);
+        if (!m_free[cls].empty()) {
+            buf.swap(m_free[cls].back());
+            m_free[cls].pop_back();
+            m_stats.pooled_bytes -= buf.capacity();
+            m_stats.reuses++;
+            buf.clear();
+            return buf;
+        }
+        nSize = CLASS_SIZE[cls];
+    }
+    // Larger than any class: allocate exactly and let Release() free it.
+    buf.reserve(nSize);
+    LOCK(cs);
+    m_stats.allocations++;
+    m_stats.bytes_allocated += buf.capacity();
+    return buf;
+}
+
+void CRecvBufferPool::Release(CSerializeData&& buf)
+{
+    // File the buffer under the largest class it can serve.
+    size_t cls = NUM_CLASSES;
+    while (cls > 0 && CLASS_SIZE[cls - 1] > buf.capacity())
+        cls--;
+    if (cls == 0 || buf.capacity() > CLASS_SIZE[NUM_CLASSES - 1])
+        return;
+    cls--;
+    LOCK(cs);
+    if (m_free[cls].size() >= CLASS_MAX_FREE[cls])
+        return;
+    m_stats.pooled_bytes += buf.capacity();
+    m_free[cls].emplace_back(std::move(buf));
+}
+
+CRecvBufferPool::Stats CRecvBufferPool::GetStats() const
+{
+    LOCK(cs);
+    return m_stats;
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -705,27 +833,63 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
+        size_t nRequested = 0;
         int nBytes = 0;
+#ifndef WIN32
+        // Hand the queued buffers (message headers and payloads) to the kernel
+        // in one call rather than one send() each.
+        struct iovec iov[MAX_SEND_IOV];
+        size_t nIov = 0;
+        auto iov_it = it;
+        for (; iov_it != pnode->vSendMsg.end() && nIov < MAX_SEND_IOV; ++iov_it, ++nIov) {
+            const size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+            iov[nIov].iov_base = const_cast<unsigned char*>(iov_it->data()) + nOffset;
+            iov[nIov].iov_len = iov_it->size() - nOffset;
+            nRequested += iov[nIov].iov_len;
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = nIov;
+        int nFlags = MSG_NOSIGNAL | MSG_DONTWAIT;
+        // More is queued than fits in this call; don't push out a partial segment
+        if (iov_it != pnode->vSendMsg.end())
+            nFlags |= MSG_MORE;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = sendmsg(pnode->hSocket, &msg, nFlags);
         }
+#else
+        nRequested = it->size() - pnode->nSendOffset;
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET)
+                break;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+        }
+#endif
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Retire every buffer that was sent completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nUnsent = it->size() - pnode->nSendOffset;
+                if (nLeft < nUnsent) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nUnsent;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nRequested) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -748,6 +912,9 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
         assert(pnode->nSendSize == 0);
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+#ifdef USE_EPOLL
+    EpollUpdateSendInterest(pnode);
+#endif
     return nSentSize;
 }
 
@@ -1006,6 +1173,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        EpollAddNode(pnode);
+#endif
     }
 }
 
@@ -1031,6 +1201,9 @@ void CConnman::DisconnectNodes()
             {
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+#ifdef USE_EPOLL
+                m_epoll_nodes.erase(pnode->GetId());
+#endif
 
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
@@ -1281,8 +1454,66 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+bool CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    char* pch = pchBuf;
+    unsigned int nMaxBytes = sizeof(pchBuf);
+    // The rest of a large payload is read straight into the message's buffer.
+    if (char* pchWindow = pnode->GetRecvWindow(sizeof(pchBuf), nMaxBytes)) {
+        pch = pchWindow;
+    }
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pch, nMaxBytes, MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pch, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            pnode->MarkReceivedMsgsForProcessing(nReceiveFloodSize);
+            WakeMessageHandler();
+        }
+        return true;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
 void CConnman::SocketHandler()
 {
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        EpollSocketHandler();
+        return;
+    }
+#endif
+
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
 
@@ -1330,58 +1561,7 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed\n");
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect)
-                        LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            SocketRecvData(pnode);
         }
 
         //
@@ -1405,6 +1585,217 @@ void CConnman::SocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+bool CConnman::EpollStart()
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("epoll_create1 failed (%s), falling back to poll()\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    for (size_t i = 0; i < vhListenSocket.size(); ++i) {
+        // Listening sockets stay level-triggered: AcceptConnection() takes a
+        // single connection per call, so a backlog must keep them reported.
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = EPOLL_LISTEN_TAG | i;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, vhListenSocket[i].socket, &event) != 0) {
+            LogPrintf("epoll_ctl failed to add listening socket (%s), falling back to poll()\n", NetworkErrorString(WSAGetLastError()));
+            EpollStop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CConnman::EpollStop()
+{
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+    {
+        LOCK(cs_vNodes);
+        m_epoll_nodes.clear();
+    }
+    m_epoll_ready.clear();
+}
+
+void CConnman::EpollAddNode(CNode* pnode)
+{
+    if (m_epoll_fd == -1)
+        return;
+
+    // The message processor may already have queued (and partially sent)
+    // our version message, so register send interest right away if needed.
+    LOCK(pnode->cs_vSend);
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    const bool want_send = !pnode->vSendMsg.empty();
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    if (want_send)
+        event.events |= EPOLLOUT;
+    event.data.u64 = pnode->GetId();
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed to add peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+        return;
+    }
+    pnode->m_epoll_registered = true;
+    pnode->m_epoll_send_interest = want_send;
+    m_epoll_nodes.emplace(pnode->GetId(), pnode);
+}
+
+void CConnman::EpollUpdateSendInterest(CNode* pnode) const
+{
+    // Only called after touching vSendMsg, so EPOLLOUT is toggled exactly when
+    // the send queue goes from empty to non-empty (an optimistic write that
+    // did not complete) or is drained again.
+    const bool want_send = !pnode->vSendMsg.empty();
+    if (m_epoll_fd == -1 || !pnode->m_epoll_registered || pnode->m_epoll_send_interest == want_send)
+        return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET)
+        return;
+    struct epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+    if (want_send)
+        event.events |= EPOLLOUT;
+    event.data.u64 = pnode->GetId();
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, pnode->hSocket, &event) == 0) {
+        pnode->m_epoll_send_interest = want_send;
+    } else {
+        LogPrint(BCLog::NET, "epoll_ctl failed to modify peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+    }
+}
+
+void CConnman::EpollSocketHandler()
+{
+    // Node sockets are edge-triggered, so a node stays in m_epoll_ready until
+    // recv()/send() would block. Don't sleep while the last round still made
+    // progress on one of them; otherwise wait for new events, waking up
+    // regularly to pick up peers whose receive side was paused.
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, EPOLL_MAX_EVENTS, m_epoll_more_work ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+            return;
+        }
+        nEvents = 0;
+    }
+
+    std::vector<size_t> vListenReady;
+    std::vector<CNode*> vNodesReady;
+    {
+        LOCK(cs_vNodes);
+        for (int i = 0; i < nEvents; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag & EPOLL_LISTEN_TAG) {
+                vListenReady.push_back(tag & ~EPOLL_LISTEN_TAG);
+                continue;
+            }
+            auto it = m_epoll_nodes.find(static_cast<NodeId>(tag));
+            if (it == m_epoll_nodes.end())
+                continue;
+            CNode* pnode = it->second;
+            // Errors and hangups are picked up by the next recv()
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                pnode->m_sock_readable = true;
+            if (events[i].events & EPOLLOUT)
+                pnode->m_sock_writable = true;
+            m_epoll_ready.insert(pnode->GetId());
+        }
+
+        vNodesReady.reserve(m_epoll_ready.size());
+        for (auto it = m_epoll_ready.begin(); it != m_epoll_ready.end();) {
+            auto node_it = m_epoll_nodes.find(*it);
+            if (node_it == m_epoll_nodes.end()) {
+                it = m_epoll_ready.erase(it);
+                continue;
+            }
+            node_it->second->AddRef();
+            vNodesReady.push_back(node_it->second);
+            ++it;
+        }
+    }
+
+    //
+    // Accept new connections
+    //
+    for (size_t i : vListenReady) {
+        if (i < vhListenSocket.size() && vhListenSocket[i].socket != INVALID_SOCKET)
+            AcceptConnection(vhListenSocket[i]);
+    }
+
+    //
+    // Service each ready socket
+    //
+    m_epoll_more_work = false;
+    for (CNode* pnode : vNodesReady)
+    {
+        if (interruptNet)
+            break;
+
+        if (pnode->m_sock_writable)
+        {
+            // Either the queue gets drained (and EPOLLOUT dropped) or send()
+            // fills the socket buffer again; both consume this edge.
+            pnode->m_sock_writable = false;
+            LOCK(pnode->cs_vSend);
+            size_t nBytes = SocketSendData(pnode);
+            if (nBytes) {
+                RecordBytesSent(nBytes);
+            }
+        }
+
+        if (pnode->m_sock_readable)
+        {
+            // Same policy as GenerateSelectSet(): drain our send queue before
+            // receiving more, and leave paused peers until the message
+            // handler catches up. The readiness is kept for later rounds.
+            bool fSendPending;
+            {
+                LOCK(pnode->cs_vSend);
+                fSendPending = !pnode->vSendMsg.empty();
+            }
+            if (!fSendPending && !pnode->fPauseRecv) {
+                if (SocketRecvData(pnode)) {
+                    m_epoll_more_work = true;
+                } else {
+                    pnode->m_sock_readable = false;
+                }
+            }
+        }
+
+        if (!pnode->m_sock_readable && !pnode->m_sock_writable)
+            m_epoll_ready.erase(pnode->GetId());
+    }
+
+    {
+        LOCK(cs_vNodes);
+        // Inactivity only has second resolution; don't walk every peer on
+        // each wakeup.
+        const int64_t nNow = GetSystemTimeInSeconds();
+        if (nNow != m_epoll_last_inactivity_check) {
+            m_epoll_last_inactivity_check = nNow;
+            for (CNode* pnode : vNodes)
+                InactivityCheck(pnode);
+        }
+        for (CNode* pnode : vNodesReady)
+            pnode->Release();
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
     while (!interruptNet)
@@ -1971,10 +2362,13 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        EpollAddNode(pnode);
+#endif
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int thread_index)
 {
     while (!flagInterruptMsgProc)
     {
@@ -1989,11 +2383,23 @@ void CConnman::ThreadMessageHandler()
 
         bool fMoreWork = false;
 
-        for (CNode* pnode : vNodesCopy)
+        // With several handler threads, each starts its round at a different
+        // peer so they rarely contend for the same one. A peer is handled by
+        // one thread at a time; the others skip it for this round, which
+        // keeps its messages in order while a slow message from one peer no
+        // longer holds up everybody else.
+        const size_t nNodes = vNodesCopy.size();
+        const size_t nOffset = nNodes * thread_index / m_msgproc_threads;
+        for (size_t i = 0; i < nNodes; ++i)
         {
+            CNode* pnode = vNodesCopy[(nOffset + i) % nNodes];
             if (pnode->fDisconnect)
                 continue;
 
+            TRY_LOCK(pnode->cs_msgProcessing, lockProcessing);
+            if (!lockProcessing)
+                continue;
+
             // Receive messages
             bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
             fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
@@ -2264,6 +2670,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         semAddnode = MakeUnique<CSemaphore>(nMaxAddnode);
     }
 
+#ifdef USE_EPOLL
+    EpollStart();
+#endif
+
     //
     // Start threads
     //
@@ -2300,7 +2710,10 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < m_msgproc_threads; ++i) {
+        const std::string thread_name = i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, i, thread_name] { TraceThread(thread_name.c_str(), std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i))); });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2349,8 +2762,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2360,6 +2776,10 @@ void CConnman::Stop()
     if (threadSocketHandler.joinable())
         threadSocketHandler.join();
 
+#ifdef USE_EPOLL
+    EpollStop();
+#endif
+
     if (fAddressesInitialized)
     {
         DumpAddresses();
@@ -2430,6 +2850,11 @@ std::vector<CAddress> CConnman::GetAddresses()
     return addrman.GetAddr();
 }
 
+std::vector<CAddress> CConnman::GetAddrSnapshot()
+{
+    return addrman.GetAddrSnapshot();
+}
+
 bool CConnman::AddNode(const std::string& strNode)
 {
     LOCK(cs_vAddedNodes);
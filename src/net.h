@@ -32,6 +32,8 @@
 #include <thread>
 #include <memory>
 #include <condition_variable>
+#include <set>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -90,6 +92,10 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
+/** -msghandlerthreads default */
+static const int DEFAULT_MSGPROC_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGPROC_THREADS = 16;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
@@ -151,6 +157,7 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        int m_msgproc_threads = DEFAULT_MSGPROC_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -176,6 +183,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_msgproc_threads = std::max(1, std::min(connOptions.m_msgproc_threads, MAX_MSGPROC_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -262,6 +270,8 @@ public:
     void MarkAddressGood(const CAddress& addr);
     void AddNewAddresses(const std::vector<CAddress>& vAddr, const CAddress& addrFrom, int64_t nTimePenalty = 0);
     std::vector<CAddress> GetAddresses();
+    //! Addresses to answer a getaddr request with; see CAddrMan::GetAddrSnapshot()
+    std::vector<CAddress> GetAddrSnapshot();
 
     // This allows temporarily exceeding m_max_outbound_full_relay, with the goal of finding
     // a peer that is better than all our current peers.
@@ -352,7 +362,7 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int thread_index);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -360,6 +370,14 @@ private:
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
+    bool SocketRecvData(CNode* pnode);
+#ifdef USE_EPOLL
+    bool EpollStart();
+    void EpollStop();
+    void EpollAddNode(CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_vNodes);
+    void EpollUpdateSendInterest(CNode* pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend);
+    void EpollSocketHandler();
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -403,6 +421,9 @@ private:
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
+    // Number of threads running ThreadMessageHandler
+    int m_msgproc_threads;
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<NetWhitelistPermissions> vWhitelistedRange;
@@ -421,6 +442,22 @@ private:
     std::vector<CNode*> vNodes GUARDED_BY(cs_vNodes);
     std::list<CNode*> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
+#ifdef USE_EPOLL
+    /**
+     * epoll instance holding a persistent registration for every listening
+     * and connected socket, or -1 to use the select()/poll() loop. Node
+     * sockets are edge-triggered, so readiness is remembered in
+     * m_epoll_ready until a read or write would block.
+     */
+    int m_epoll_fd{-1};
+    /** Nodes registered with m_epoll_fd, looked up by the NodeId carried in each event */
+    std::unordered_map<NodeId, CNode*> m_epoll_nodes GUARDED_BY(cs_vNodes);
+    /** Nodes with unconsumed readiness. Only used by the socket handler thread. */
+    std::set<NodeId> m_epoll_ready;
+    /** Whether the last round made progress on a node in m_epoll_ready */
+    bool m_epoll_more_work{false};
+    int64_t m_epoll_last_inactivity_check{0};
+#endif
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
@@ -474,7 +511,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -616,6 +653,45 @@ public:
 
 
 
+/**
+ * Pool of message payload buffers, grouped in size classes.
+ *
+ * Payloads are received into buffers taken from the pool, and the buffers go
+ * back to the pool once the message has been processed. A steady stream of
+ * messages therefore reuses a small set of allocations instead of allocating,
+ * growing and zeroing a fresh buffer for every message.
+ */
+class CRecvBufferPool
+{
+public:
+    struct Stats {
+        uint64_t allocations{0};    //!< buffers allocated because the pool had none of the class
+        uint64_t reuses{0};         //!< buffers handed out from the pool
+        uint64_t bytes_allocated{0};
+        size_t pooled_bytes{0};     //!< capacity of the buffers currently held by the pool
+    };
+
+    /** Return an empty buffer with capacity for at least nSize bytes. */
+    CSerializeData Acquire(size_t nSize);
+    /** Give a buffer back. It is kept if its size class is not full, and freed otherwise. */
+    void Release(CSerializeData&& buf);
+
+    Stats GetStats() const;
+
+private:
+    static constexpr size_t NUM_CLASSES = 5;
+    /** Capacity of the buffers in each class. The largest fits any message we accept. */
+    static constexpr size_t CLASS_SIZE[NUM_CLASSES] = {1024, 16 * 1024, 256 * 1024, 1024 * 1024, MAX_PROTOCOL_MESSAGE_LENGTH};
+    /** Number of free buffers kept per class, about 14 MB in total. */
+    static constexpr size_t CLASS_MAX_FREE[NUM_CLASSES] = {256, 64, 16, 4, 2};
+
+    mutable CCriticalSection cs;
+    std::vector<CSerializeData> m_free[NUM_CLASSES] GUARDED_BY(cs);
+    Stats m_stats GUARDED_BY(cs);
+};
+
+extern CRecvBufferPool g_recv_buffer_pool;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -639,6 +715,8 @@ public:
         nDataPos = 0;
         nTime = 0;
     }
+    CNetMessage(const CNetMessage&) = default;
+    ~CNetMessage();
 
     bool complete() const
     {
@@ -657,6 +735,8 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+    /** Make room in vRecv for the next nBytes of payload, growing from the buffer pool. */
+    void PrepareData(unsigned int nBytes);
 };
 
 
@@ -681,6 +761,10 @@ public:
     size_t nProcessQueueSize{0};
 
     CCriticalSection cs_sendProcessing;
+    // Held by the message handler thread currently running ProcessMessages()
+    // and SendMessages() for this node, keeping per-peer message order when
+    // there is more than one handler thread
+    CCriticalSection cs_msgProcessing;
 
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes GUARDED_BY(cs_vRecv){0};
@@ -725,6 +809,15 @@ public:
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
 
+    // Edge-triggered readiness last reported for this socket, consumed by
+    // the socket handler thread until recv()/send() would block
+    bool m_sock_readable{false};
+    bool m_sock_writable{false};
+    // Whether the socket is registered with CConnman's epoll instance, and
+    // whether that registration currently includes EPOLLOUT
+    bool m_epoll_registered GUARDED_BY(cs_vSend){false};
+    bool m_epoll_send_interest GUARDED_BY(cs_vSend){false};
+
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd GUARDED_BY(cs_vRecv);
@@ -734,8 +827,11 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Any message handler thread may queue addresses here (see RelayAddress),
+    // so both are guarded by cs_vAddrToSend.
+    CCriticalSection cs_vAddrToSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_vAddrToSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_vAddrToSend);
     bool fGetAddr{false};
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
     int64_t nNextLocalAddrSend GUARDED_BY(cs_sendProcessing){0};
@@ -861,6 +957,15 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /** Move the complete messages at the front of vRecvMsg to the processing queue. */
+    void MarkReceivedMsgsForProcessing(unsigned int nRecvFloodSize);
+    /**
+     * If the message being received still expects at least nMin payload bytes,
+     * return where the next of them go in its payload buffer and set nBytes to
+     * the room available there. Data read into that window is passed to
+     * ReceiveMsgBytes as usual, which then skips copying it.
+     */
+    char* GetRecvWindow(unsigned int nMin, unsigned int& nBytes);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -892,11 +997,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_vAddrToSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
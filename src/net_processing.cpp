@@ -11,15 +11,21 @@
 #include <banman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockfilter.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <validation.h>
 #include <merkleblock.h>
 #include <netmessagemaker.h>
 #include <netbase.h>
+#include <node/blockdownload.h>
+#include <node/responsecache.h>
+#include <node/txreconciliation.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
+#include <pow.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
@@ -77,6 +83,10 @@ static constexpr std::chrono::microseconds CHRONO_GETDATA_TX_INTERVAL{std::chron
 static constexpr std::chrono::microseconds MAX_GETDATA_RANDOM_DELAY{std::chrono::seconds{2}};
 /** How long to wait (in microseconds) before expiring an in-flight getdata request to a peer */
 static constexpr std::chrono::microseconds TX_EXPIRY_INTERVAL{GETDATA_TX_INTERVAL * 10};
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 struct COrphanTx {
     // When modifying, adapt the copy of this definition in tests/DoS_tests.
@@ -141,6 +151,9 @@ namespace {
      * Memory used: 1.3 MB
      */
     std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(cs_main);
+
+    /** Set reconciliation of transaction announcements, if enabled with -txreconciliation. */
+    std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
     uint256 hashRecentRejectsChainTip GUARDED_BY(cs_main);
 
     /** Blocks that are in flight, and that are in the queue to be downloaded. */
@@ -149,9 +162,16 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        std::chrono::microseconds m_time_requested;              //!< When the block was requested from this peer.
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
+    /** Sizes the block download windows from peer throughput and the validation backlog. */
+    BlockDownloadScheduler g_block_download_scheduler;
+
+    /** Serialized getheaders and getdata responses for the runs and blocks most peers ask for. */
+    SerializedResponseCache g_response_cache;
+
     /** Stack of nodes which we have set to announce using compact blocks */
     std::list<NodeId> lNodesAnnouncingHeaderAndIDs GUARDED_BY(cs_main);
 
@@ -478,7 +498,7 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTime<std::chrono::microseconds>()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -494,6 +514,14 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     return true;
 }
 
+/** Feed the download scheduler if the block arrived from the peer we requested it from. */
+static void RecordBlockDelivery(NodeId nodeid, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight != mapBlocksInFlight.end() && itInFlight->second.first == nodeid) {
+        g_block_download_scheduler.BlockReceived(nodeid, hash, itInFlight->second.second->m_time_requested, GetTime<std::chrono::microseconds>());
+    }
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 static void ProcessBlockAvailability(NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     CNodeState *state = State(nodeid);
@@ -627,10 +655,11 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + g_block_download_scheduler.GetDownloadWindow();
+    const auto current_time = GetTime<std::chrono::microseconds>();
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -677,7 +706,18 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                 }
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
-                waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                const auto& in_flight = mapBlocksInFlight[pindex->GetBlockHash()];
+                waitingfor = in_flight.first;
+                // It holds up the window, so take it over if we would deliver it much sooner.
+                if (waitingfor != nodeid) {
+                    const int blocks_ahead = std::distance(State(waitingfor)->vBlocksInFlight.begin(), in_flight.second);
+                    if (!g_block_download_scheduler.ShouldRerequest(waitingfor, in_flight.second->m_time_requested, blocks_ahead, nodeid, state->nBlocksInFlight, current_time)) continue;
+                    LogPrint(BCLog::NET, "Block %s (%d) is overdue from peer=%d, requesting it from peer=%d\n", pindex->GetBlockHash().ToString(), pindex->nHeight, waitingfor, nodeid);
+                    vBlocks.push_back(pindex);
+                    if (vBlocks.size() == count) {
+                        return;
+                    }
+                }
             }
         }
     }
@@ -774,6 +814,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
 
     mapNodeState.erase(nodeid);
+    g_block_download_scheduler.ForgetPeer(nodeid);
+    if (g_txreconciliation) g_txreconciliation->ForgetPeer(nodeid);
 
     if (mapNodeState.empty()) {
         // Do a consistency check after the last peer is removed.
@@ -1068,6 +1110,11 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     : connman(connmanIn), m_banman(banman), m_stale_tip_check_time(0), m_enable_bip61(enable_bip61) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        g_txreconciliation.reset(new TxReconciliationTracker());
+    } else {
+        g_txreconciliation.reset();
+    }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -1083,6 +1130,8 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
  * block. Also save the time of the last tip update.
  */
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
+    g_block_download_scheduler.BlockConnected(pindex->GetBlockHash(), GetTime<std::chrono::microseconds>());
+
     LOCK(g_cs_orphans);
 
     std::vector<uint256> vOrphanErase;
@@ -1213,6 +1262,7 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
     std::map<uint256, std::pair<NodeId, bool>>::iterator it = mapBlockSource.find(hash);
 
     if (state.IsInvalid()) {
+        g_block_download_scheduler.ForgetBlock(hash);
         // Don't send reject message with code 0 or an internal reject code.
         if (it != mapBlockSource.end() && State(it->second.first) && state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) {
             CBlockReject reject = {(unsigned char)state.GetRejectCode(), state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), hash};
@@ -1362,63 +1412,122 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-        }
-    }
+    const CBlockIndex* pindex;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    // never disconnect whitelisted nodes
-    if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+    bool fPeerWantsWitness = false;
+    bool fCanSendCmpct = false;
+    bool fCacheBlock = false;
+    uint256 hashContinueTip;
     {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->HasPermission(PF_NOBAN))
+        {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-        //disconnect node
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom->HasPermission(PF_NOBAN) && (
-            (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom->HasPermission(PF_NOBAN) && (
+                (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (::ChainActive().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        send = send && (pindex->nStatus & BLOCK_HAVE_DATA);
+        if (send) {
+            if (inv.type == MSG_CMPCT_BLOCK) {
+                fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+                fCanSendCmpct = CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+            }
+            if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+                fCacheBlock = pindex->nHeight > ::ChainActive().Height() - (int)MAX_CACHED_BLOCKS;
+            }
+            if (inv.hash == pfrom->hashContinue) {
+                hashContinueTip = ::ChainActive().Tip()->GetBlockHash();
+            }
+        }
+    } // release cs_main before reading the block from disk
+
+    if (send)
     {
+        // The block may be pruned once cs_main is released; only a read
+        // failure for a block we still claim to have is fatal.
+        auto block_read_failed = [&]() {
+            if (WITH_LOCK(cs_main, return pindex->nStatus & BLOCK_HAVE_DATA)) {
+                assert(!"cannot load block from disk");
+            }
+            LogPrint(BCLog::NET, "Block was pruned before it could be read, disconnect peer=%d\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+        };
+
         std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        // Blocks near the tip are kept serialized, as every peer is about to ask for them
+        const bool fWitness = inv.type == MSG_WITNESS_BLOCK;
+        SerializedResponseCache::Payload cached_block;
+        if (fCacheBlock) {
+            cached_block = g_response_cache.GetBlock(pindex->GetBlockHash(), fWitness);
+        }
+        if (cached_block) {
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.data = *cached_block;
+            connman->PushMessage(pfrom, std::move(msg));
+        } else if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
+        } else if (inv.type == MSG_WITNESS_BLOCK || inv.type == MSG_BLOCK) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
+            // as the network format matches the format on disk (for MSG_BLOCK only when
+            // the block carries no witness data)
             std::vector<uint8_t> block_data;
             if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
+                block_read_failed();
+                return;
+            }
+            if (inv.type == MSG_WITNESS_BLOCK || IsRawBlockWitnessFree(block_data)) {
+                if (fCacheBlock) {
+                    g_response_cache.AddBlock(pindex->GetBlockHash(), fWitness, block_data);
+                }
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+                // Don't set pblock as we've sent the block
+            } else {
+                // Witness data has to be stripped; reuse the bytes already read
+                std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+                VectorReader(SER_NETWORK, PROTOCOL_VERSION, block_data, 0) >> *pblockRead;
+                pblock = pblockRead;
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
+            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+                block_read_failed();
+                return;
+            }
             pblock = pblockRead;
         }
         if (pblock) {
-            if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_WITNESS_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+                CSerializedNetMsg msg = msgMaker.Make(fWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock);
+                if (fCacheBlock) {
+                    g_response_cache.AddBlock(pindex->GetBlockHash(), fWitness, msg.data);
+                }
+                connman->PushMessage(pfrom, std::move(msg));
+            }
             else if (inv.type == MSG_FILTERED_BLOCK)
             {
                 bool sendMerkleBlock = false;
@@ -1451,9 +1560,8 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                 // they won't have a useful mempool to match against a compact block,
                 // and we don't feel like constructing the object for them, so
                 // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
                 int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
+                if (fCanSendCmpct) {
                     if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
                         connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                     } else {
@@ -1467,13 +1575,13 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
 
         // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom->hashContinue)
+        if (!hashContinueTip.IsNull())
         {
             // Bypass PushInventory, this must send even if redundant,
             // and we want it right after the last block so they don't
             // wait for other stuff first.
             std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
+            vInv.push_back(CInv(MSG_BLOCK, hashContinueTip));
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
             pfrom->hashContinue.SetNull();
         }
@@ -1647,9 +1755,18 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
         }
     }
 
+    // Verify the proof of work of new headers before ProcessNewBlockHeaders()
+    // takes cs_main: with our slow hash algorithms this is most of the cost
+    // of accepting headers. On any failure the headers are checked again
+    // under the lock, so invalid ones are reported and punished as before.
+    bool fPowChecked = received_new_header;
+    for (size_t i = 0; fPowChecked && i < nCount; ++i) {
+        fPowChecked = CheckProofOfWork(GetPoWAlgoHash(headers[i]), headers[i].nBits, chainparams.GetConsensus());
+    }
+
     CValidationState state;
     CBlockHeader first_invalid_header;
-    if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast, &first_invalid_header)) {
+    if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindexLast, &first_invalid_header, !fPowChecked)) {
         if (state.IsInvalid()) {
             MaybePunishNode(pfrom->GetId(), state, via_compact_block, "invalid header received");
             return false;
@@ -1833,6 +1950,219 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/** Announce by inv the transactions a reconciliation round found the peer to be missing. */
+static void AnnounceReconciledTransactions(CNode* pfrom, CConnman* connman, const CNetMsgMaker& msgMaker, const std::vector<uint256>& announce)
+{
+    std::vector<CInv> vInv;
+    for (const uint256& hash : announce) {
+        // Not in the mempool anymore? don't bother sending it.
+        if (!mempool.exists(hash)) continue;
+        const CInv inv(MSG_TX, hash);
+        pfrom->AddInventoryKnown(inv);
+        vInv.push_back(inv);
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty()) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+    }
+}
+
+/**
+ * Validates a request for block filters or filter headers: the filter type
+ * must be served, the stop block must exist and be allowed to be fetched,
+ * and the range must not be too long. Peers making invalid requests are
+ * disconnected.
+ *
+ * @param[in]  pfrom           The peer that we received the request from
+ * @param[in]  chain_params    Chain parameters
+ * @param[in]  filter_type     The filter type the request is for
+ * @param[in]  start_height    The start height for the request
+ * @param[in]  stop_hash       The stop_hash for the request
+ * @param[in]  max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out] stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced
+ * @param[out] filter_index    The filter index, if the request can be serviced
+ * @return                     True if the request can be serviced
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chain_params,
+                                      BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/** Handle a getcfilters request: send a cfilter message for each block in the range. */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                               CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a getcfheaders request: send the filter header of the block before
+ * the range and the filter hashes of the blocks in it.
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFHEADERS,
+                                              filter_type_ser,
+                                              stop_index->GetBlockHash(),
+                                              prev_header,
+                                              filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request: send the filter headers of every
+ * CFCHECKPT_INTERVAL'th block up to the stop block.
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFCHECKPT,
+                                              filter_type_ser,
+                                              stop_index->GetBlockHash(),
+                                              headers));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool enable_bip61)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1968,6 +2298,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         if (pfrom->fInbound)
             PushNodeVersion(pfrom, connman, GetAdjustedTime());
 
+        // Reconciliation must be offered before verack (BIP 330)
+        if (g_txreconciliation && nVersion >= TXRECONCILIATION_VERSION && fRelay && g_relay_txes && pfrom->m_tx_relay != nullptr) {
+            const uint64_t recon_salt = g_txreconciliation->PreRegisterPeer(pfrom->GetId());
+            connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_PROTOCOL_VERSION, recon_salt));
+        }
+
         connman->PushMessage(pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
 
         pfrom->nServices = nServices;
@@ -2106,6 +2442,36 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         pfrom->fSuccessfullyConnected = true;
     }
 
+    if (strCommand == NetMsgType::SENDTXRCNCL) {
+        if (!g_txreconciliation) {
+            LogPrint(BCLog::NET, "sendtxrcncl from peer=%d ignored, as reconciliation is disabled\n", pfrom->GetId());
+            return true;
+        }
+        if (pfrom->fSuccessfullyConnected) {
+            LogPrint(BCLog::NET, "sendtxrcncl received after verack from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        uint32_t peer_recon_version;
+        uint64_t remote_salt;
+        vRecv >> peer_recon_version >> remote_salt;
+        const TxReconciliationTracker::RegisterResult result = g_txreconciliation->RegisterPeer(pfrom->GetId(), pfrom->fInbound, peer_recon_version, remote_salt);
+        switch (result) {
+        case TxReconciliationTracker::RegisterResult::SUCCESS:
+            LogPrint(BCLog::NET, "peer=%d will reconcile transaction announcements\n", pfrom->GetId());
+            break;
+        case TxReconciliationTracker::RegisterResult::NOT_FOUND:
+            // We did not offer reconciliation to this peer.
+            break;
+        case TxReconciliationTracker::RegisterResult::ALREADY_REGISTERED:
+        case TxReconciliationTracker::RegisterResult::PROTOCOL_VIOLATION:
+            LogPrint(BCLog::NET, "invalid sendtxrcncl from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        return true;
+    }
+
     if (!pfrom->fSuccessfullyConnected) {
         // Must have a verack message before anything else
         LOCK(cs_main);
@@ -2243,6 +2609,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             else
             {
                 pfrom->AddInventoryKnown(inv);
+                if (g_txreconciliation) g_txreconciliation->TryRemovingFromSet(pfrom->GetId(), inv.hash);
                 if (fBlocksOnly) {
                     LogPrint(BCLog::NET, "transaction (%s) inv sent in violation of protocol, disconnecting peer=%d\n", inv.hash.ToString(), pfrom->GetId());
                     pfrom->fDisconnect = true;
@@ -2256,6 +2623,50 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    if (strCommand == NetMsgType::REQRECON) {
+        uint16_t remote_set_size, remote_q;
+        vRecv >> remote_set_size >> remote_q;
+        std::vector<unsigned char> sketch;
+        if (!g_txreconciliation || !g_txreconciliation->HandleReconciliationRequest(pfrom->GetId(), remote_set_size, remote_q, sketch)) {
+            LogPrint(BCLog::NET, "unexpected reqrecon from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, sketch));
+        return true;
+    }
+
+    if (strCommand == NetMsgType::SKETCH) {
+        std::vector<unsigned char> sketch;
+        vRecv >> sketch;
+        bool success;
+        std::vector<uint32_t> ask_shortids;
+        std::vector<uint256> announce;
+        if (!g_txreconciliation || !g_txreconciliation->HandleSketch(pfrom->GetId(), sketch, success, ask_shortids, announce)) {
+            LogPrint(BCLog::NET, "unexpected sketch from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s: announcing %u, requesting %u\n", pfrom->GetId(), success ? "succeeded" : "failed", announce.size(), ask_shortids.size());
+        AnnounceReconciledTransactions(pfrom, connman, msgMaker, announce);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, success, ask_shortids));
+        return true;
+    }
+
+    if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool success;
+        std::vector<uint32_t> ask_shortids;
+        vRecv >> success >> ask_shortids;
+        std::vector<uint256> announce;
+        if (!g_txreconciliation || !g_txreconciliation->HandleReconciliationDifference(pfrom->GetId(), success, ask_shortids, announce)) {
+            LogPrint(BCLog::NET, "unexpected reconcildiff from peer=%d; disconnecting\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+        AnnounceReconciledTransactions(pfrom, connman, msgMaker, announce);
+        return true;
+    }
+
     if (strCommand == NetMsgType::GETDATA) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -2429,9 +2840,26 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             pindex = FindForkInGlobalIndex(::ChainActive(), locator);
             if (pindex)
                 pindex = ::ChainActive().Next(pindex);
+
+            // Peers syncing from the same fork point get the same run of headers. A
+            // cached run is still current if it ends in the active chain, and either
+            // stopped where it had to or still ends at our tip.
+            SerializedResponseCache::HeadersRun run;
+            if (pindex && g_response_cache.GetHeaders(pindex->GetBlockHash(), hashStop, run) &&
+                ::ChainActive().Contains(run.last) &&
+                (run.count == MAX_HEADERS_RESULTS || run.last->GetBlockHash() == hashStop || run.last == ::ChainActive().Tip())) {
+                LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d (cached)\n", pindex->nHeight, hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
+                nodestate->pindexBestHeaderSent = run.last;
+                CSerializedNetMsg msg;
+                msg.command = NetMsgType::HEADERS;
+                msg.data = *run.payload;
+                connman->PushMessage(pfrom, std::move(msg));
+                return true;
+            }
         }
 
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
+        const CBlockIndex* pindexStart = locator.IsNull() ? nullptr : pindex;
         std::vector<CBlock> vHeaders;
         int nLimit = MAX_HEADERS_RESULTS;
         LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
@@ -2454,7 +2882,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : ::ChainActive().Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        CSerializedNetMsg msg = msgMaker.Make(NetMsgType::HEADERS, vHeaders);
+        if (pindexStart) {
+            g_response_cache.AddHeaders(pindexStart->GetBlockHash(), hashStop, nodestate->pindexBestHeaderSent, vHeaders.size(), msg.data);
+        }
+        connman->PushMessage(pfrom, std::move(msg));
     }
 
     if (strCommand == NetMsgType::TX) {
@@ -2947,12 +3379,23 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
 
+        // Run the context-free checks (proof of work, merkle root) before
+        // ProcessNewBlock() takes cs_main, so a slow block doesn't hold up
+        // the other message handler threads. The block isn't shared yet, so
+        // setting fChecked here is race-free. A failing block is checked
+        // again under the lock and rejected through the usual path.
+        {
+            CValidationState dummy_state;
+            CheckBlock(*pblock, dummy_state, chainparams.GetConsensus());
+        }
+
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            RecordBlockDelivery(pfrom->GetId(), hash);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2991,8 +3434,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
-        std::vector<CAddress> vAddr = connman->GetAddresses();
+        WITH_LOCK(pfrom->cs_vAddrToSend, pfrom->vAddrToSend.clear());
+        std::vector<CAddress> vAddr = connman->GetAddrSnapshot();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
             if (!g_banman->IsBanned(addr)) {
@@ -3170,6 +3613,21 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
     if (strCommand == NetMsgType::NOTFOUND) {
         // Remove the NOTFOUND transactions from the peer
         LOCK(cs_main);
@@ -3580,27 +4038,29 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (pto->IsAddrRelayPeer() && pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
             std::vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            for (const CAddress& addr : pto->vAddrToSend)
             {
-                if (!pto->addrKnown.contains(addr.GetKey()))
+                // Collect under the lock, other peers' handlers may be
+                // relaying addresses to this peer concurrently
+                LOCK(pto->cs_vAddrToSend);
+                vAddr.reserve(pto->vAddrToSend.size());
+                for (const CAddress& addr : pto->vAddrToSend)
                 {
-                    pto->addrKnown.insert(addr.GetKey());
-                    vAddr.push_back(addr);
-                    // receiver rejects addr messages larger than 1000
-                    if (vAddr.size() >= 1000)
+                    if (!pto->addrKnown.contains(addr.GetKey()))
                     {
-                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-                        vAddr.clear();
+                        pto->addrKnown.insert(addr.GetKey());
+                        vAddr.push_back(addr);
                     }
                 }
+                pto->vAddrToSend.clear();
+                // we only send the big addr message once
+                if (pto->vAddrToSend.capacity() > 40)
+                    pto->vAddrToSend.shrink_to_fit();
+            }
+            // receiver rejects addr messages larger than 1000
+            for (size_t nStart = 0; nStart < vAddr.size(); nStart += 1000) {
+                const size_t nEnd = std::min(vAddr.size(), nStart + 1000);
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, std::vector<CAddress>(vAddr.begin() + nStart, vAddr.begin() + nEnd)));
             }
-            pto->vAddrToSend.clear();
-            if (!vAddr.empty())
-                connman->PushMessage(pto, msgMaker.Make(NetMsgType::ADDR, vAddr));
-            // we only send the big addr message once
-            if (pto->vAddrToSend.capacity() > 40)
-                pto->vAddrToSend.shrink_to_fit();
         }
 
         // Start block sync
@@ -3879,8 +4339,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                             continue;
                         }
                         if (pto->m_tx_relay->pfilter && !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                        // Send
-                        vInv.push_back(CInv(MSG_TX, hash));
+                        // Send, or leave it to the next reconciliation round with the peer
+                        if (!g_txreconciliation || !g_txreconciliation->AddToSet(pto->GetId(), hash)) {
+                            vInv.push_back(CInv(MSG_TX, hash));
+                        }
                         nRelayedTransactions++;
                         {
                             // Expire old relay messages
@@ -3907,6 +4369,16 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reconciliation request
+        //
+        if (g_txreconciliation) {
+            uint16_t recon_set_size, recon_q;
+            if (g_txreconciliation->InitiateReconciliationRequest(pto->GetId(), GetTime<std::chrono::microseconds>(), recon_set_size, recon_q)) {
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, recon_set_size, recon_q));
+            }
+        }
+
         // Detect whether we're stalling
         auto current_time = GetTime<std::chrono::microseconds>();
         // nNow is the current system time (GetTimeMicros is not mockable) and
@@ -3975,10 +4447,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nPeerBlockWindow = g_block_download_scheduler.GetPeerWindow(pto->GetId());
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !::ChainstateActive().IsInitialBlockDownload()) && state.nBlocksInFlight < nPeerBlockWindow) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nPeerBlockWindow - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -0,0 +1,129 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockdownload.h>
+
+#include <validation.h>
+
+#include <algorithm>
+#include <limits>
+
+/** Fold a new sample into a moving average that weighs it 1/4. */
+static std::chrono::microseconds UpdateAverage(std::chrono::microseconds average, std::chrono::microseconds sample)
+{
+    // One microsecond rather than zero, which means "not measured"
+    sample = std::max(sample, std::chrono::microseconds{1});
+    if (average.count() == 0) return sample;
+    return (average * 3 + sample) / 4;
+}
+
+void BlockDownloadScheduler::BlockReceived(NodeId peer_id, const uint256& hash, std::chrono::microseconds time_requested, std::chrono::microseconds now)
+{
+    LOCK(m_mutex);
+    PeerStats& stats = m_peers[peer_id];
+    // The peer sends blocks one after another, so a block's time starts when
+    // the previous one arrived unless it was requested later than that.
+    stats.m_block_time = UpdateAverage(stats.m_block_time, now - std::max(time_requested, stats.m_last_received));
+    stats.m_last_received = now;
+
+    for (auto it = m_unvalidated.begin(); it != m_unvalidated.end();) {
+        if (it->second + UNVALIDATED_BLOCK_EXPIRY < now) {
+            it = m_unvalidated.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_unvalidated.emplace(hash, now);
+}
+
+void BlockDownloadScheduler::BlockConnected(const uint256& hash, std::chrono::microseconds now)
+{
+    LOCK(m_mutex);
+    auto it = m_unvalidated.find(hash);
+    if (it == m_unvalidated.end()) return;
+    // A block waiting for its parent was not being validated before the parent connected.
+    m_validation_time = UpdateAverage(m_validation_time, now - std::max(it->second, m_last_connected));
+    m_last_connected = now;
+    m_unvalidated.erase(it);
+}
+
+void BlockDownloadScheduler::ForgetBlock(const uint256& hash)
+{
+    LOCK(m_mutex);
+    m_unvalidated.erase(hash);
+}
+
+void BlockDownloadScheduler::ForgetPeer(NodeId peer_id)
+{
+    LOCK(m_mutex);
+    m_peers.erase(peer_id);
+}
+
+unsigned int BlockDownloadScheduler::DownloadWindow() const
+{
+    if (m_validation_time.count() == 0) return BLOCK_DOWNLOAD_WINDOW;
+    const int64_t window = std::chrono::microseconds{BLOCK_DOWNLOAD_WINDOW_TIME} / m_validation_time;
+    return std::max<int64_t>(MIN_BLOCK_DOWNLOAD_WINDOW, std::min<int64_t>(BLOCK_DOWNLOAD_WINDOW, window));
+}
+
+unsigned int BlockDownloadScheduler::GetPeerWindow(NodeId peer_id) const
+{
+    LOCK(m_mutex);
+    uint64_t window = INITIAL_BLOCKS_IN_TRANSIT_PER_PEER;
+    auto it = m_peers.find(peer_id);
+    if (it != m_peers.end() && it->second.m_block_time.count() > 0) {
+        const std::chrono::microseconds queue_time{BLOCK_DOWNLOAD_QUEUE_TIME};
+        window = std::min<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, (queue_time + it->second.m_block_time - std::chrono::microseconds{1}) / it->second.m_block_time);
+    }
+    // Once we know how fast we validate, scale down as the backlog fills the download window
+    if (m_validation_time.count() > 0) {
+        const size_t download_window = DownloadWindow();
+        const size_t backlog = std::min(m_unvalidated.size(), download_window);
+        window = window * (download_window - backlog) / download_window;
+    }
+    return std::max<uint64_t>(window, 1);
+}
+
+unsigned int BlockDownloadScheduler::GetDownloadWindow() const
+{
+    LOCK(m_mutex);
+    return DownloadWindow();
+}
+
+bool BlockDownloadScheduler::ShouldRerequest(NodeId holder, std::chrono::microseconds time_requested, int blocks_ahead, NodeId candidate, int candidate_in_flight, std::chrono::microseconds now) const
+{
+    LOCK(m_mutex);
+    if (now - time_requested < BLOCK_REREQUEST_MIN_DELAY) return false;
+    auto candidate_it = m_peers.find(candidate);
+    if (candidate_it == m_peers.end() || candidate_it->second.m_block_time.count() == 0) return false;
+    const std::chrono::microseconds candidate_block_time = candidate_it->second.m_block_time;
+
+    auto holder_it = m_peers.find(holder);
+    if (holder_it == m_peers.end() || holder_it->second.m_block_time.count() == 0) {
+        // Nothing at all from the holder since we asked
+        return true;
+    }
+    const std::chrono::microseconds holder_block_time = holder_it->second.m_block_time;
+    // Only move a block to a faster peer, so it cannot bounce back.
+    if (candidate_block_time >= holder_block_time) return false;
+
+    // Peers send blocks in the order we asked for them.
+    const std::chrono::microseconds holder_eta = std::max(time_requested, holder_it->second.m_last_received) + holder_block_time * (blocks_ahead + 1);
+    if (now > holder_eta + holder_block_time * (BLOCK_REREQUEST_FACTOR - 1)) return true;
+    const std::chrono::microseconds candidate_wait = candidate_block_time * (candidate_in_flight + 1);
+    return holder_eta - now > candidate_wait * BLOCK_REREQUEST_FACTOR;
+}
+
+size_t BlockDownloadScheduler::GetValidationBacklog() const
+{
+    LOCK(m_mutex);
+    return m_unvalidated.size();
+}
+
+std::chrono::microseconds BlockDownloadScheduler::GetPeerBlockTime(NodeId peer_id) const
+{
+    LOCK(m_mutex);
+    auto it = m_peers.find(peer_id);
+    return it == m_peers.end() ? std::chrono::microseconds{0} : it->second.m_block_time;
+}
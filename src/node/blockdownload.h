@@ -0,0 +1,102 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef AURORACOIN_NODE_BLOCKDOWNLOAD_H
+#define AURORACOIN_NODE_BLOCKDOWNLOAD_H
+
+#include <net.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <map>
+#include <unordered_map>
+
+/** Blocks requested from a peer before we know how fast it delivers. */
+static const unsigned int INITIAL_BLOCKS_IN_TRANSIT_PER_PEER = 8;
+/** Keep enough blocks in flight to each peer for it to stay busy this long. */
+static constexpr std::chrono::seconds BLOCK_DOWNLOAD_QUEUE_TIME{4};
+/** Download window: how far ahead of the last block we have, in seconds of validation. */
+static constexpr std::chrono::seconds BLOCK_DOWNLOAD_WINDOW_TIME{20};
+/** Smallest download window, however slowly blocks validate. */
+static const unsigned int MIN_BLOCK_DOWNLOAD_WINDOW = 64;
+/**
+ * A block holding up the download window is re-requested from another peer
+ * once its own peer is this many block times late, or if the other peer
+ * would deliver it this many times sooner...
+ */
+static const int BLOCK_REREQUEST_FACTOR = 3;
+/** ...but not before it has been in flight this long. */
+static constexpr std::chrono::milliseconds BLOCK_REREQUEST_MIN_DELAY{1000};
+/** Received blocks that never connect stop counting towards the backlog after this long. */
+static constexpr std::chrono::minutes UNVALIDATED_BLOCK_EXPIRY{10};
+
+/**
+ * Sizes the block download windows from what the node actually achieves.
+ *
+ * Each peer's in-flight limit follows how quickly it delivers blocks, so a
+ * slow peer is not handed a full MAX_BLOCKS_IN_TRANSIT_PER_PEER batch that the
+ * whole download then waits on. The time a block takes to arrive includes the
+ * time it waits behind other messages for the message handler, so when
+ * validation is the bottleneck every peer looks slower and we fetch less.
+ *
+ * The lookahead beyond the last block in common with a peer is what we can
+ * validate in BLOCK_DOWNLOAD_WINDOW_TIME. Blocks received but not yet
+ * connected are the validation backlog, and the per-peer windows shrink as
+ * it fills that lookahead.
+ *
+ * The block that keeps the download window from moving is re-requested from
+ * a faster peer once its own peer is late with it, or would take much longer
+ * to get to it, which is usually long before that peer would be disconnected
+ * for stalling.
+ *
+ * Callers hold cs_main; the scheduler has its own lock for the validation
+ * interface callbacks.
+ */
+class BlockDownloadScheduler
+{
+public:
+    /** A block we requested from the peer at time_requested has arrived. */
+    void BlockReceived(NodeId peer_id, const uint256& hash, std::chrono::microseconds time_requested, std::chrono::microseconds now);
+    /** The block was connected to the active chain. */
+    void BlockConnected(const uint256& hash, std::chrono::microseconds now);
+    /** The block turned out invalid and will never be connected. */
+    void ForgetBlock(const uint256& hash);
+    void ForgetPeer(NodeId peer_id);
+
+    /** How many blocks may be in flight from the peer. */
+    unsigned int GetPeerWindow(NodeId peer_id) const;
+    /** How far beyond the last block in common with a peer we download. */
+    unsigned int GetDownloadWindow() const;
+    /**
+     * Whether to ask candidate for a block that holder was asked for at
+     * time_requested, after blocks_ahead others. candidate_in_flight is the
+     * number of blocks candidate has yet to send us.
+     */
+    bool ShouldRerequest(NodeId holder, std::chrono::microseconds time_requested, int blocks_ahead, NodeId candidate, int candidate_in_flight, std::chrono::microseconds now) const;
+
+    /** Blocks received and not yet connected. */
+    size_t GetValidationBacklog() const;
+    /** Average time between blocks from the peer, or zero if not measured yet. */
+    std::chrono::microseconds GetPeerBlockTime(NodeId peer_id) const;
+
+private:
+    struct PeerStats {
+        //! moving average of the time the peer takes per block
+        std::chrono::microseconds m_block_time{0};
+        std::chrono::microseconds m_last_received{0};
+    };
+
+    mutable Mutex m_mutex;
+    std::unordered_map<NodeId, PeerStats> m_peers GUARDED_BY(m_mutex);
+    //! received and not yet connected blocks, with the time they arrived
+    std::map<uint256, std::chrono::microseconds> m_unvalidated GUARDED_BY(m_mutex);
+    //! moving average of the time it takes to connect a block
+    std::chrono::microseconds m_validation_time GUARDED_BY(m_mutex){0};
+    std::chrono::microseconds m_last_connected GUARDED_BY(m_mutex){0};
+
+    unsigned int DownloadWindow() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // AURORACOIN_NODE_BLOCKDOWNLOAD_H
@@ -10,8 +10,11 @@
 #include <uint256.h>
 
 #include <cstdint>
+#include <map>
 
 class CCoinsView;
+class CHashWriter;
+class Coin;
 
 struct CCoinsStats
 {
@@ -30,4 +33,8 @@ struct CCoinsStats
 //! Calculate statistics about the unspent transaction output set
 bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
 
+//! Add the unspent outputs of one transaction to the statistics and to the
+//! serialized hash; transactions must be applied in txid order.
+void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs);
+
 #endif // AURORACOIN_NODE_COINSTATS_H
\ No newline at end of file
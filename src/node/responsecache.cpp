@@ -0,0 +1,50 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/responsecache.h>
+
+SerializedResponseCache::SerializedResponseCache(size_t max_header_runs, size_t max_blocks)
+    : m_headers(max_header_runs), m_blocks(2 * max_blocks)
+{
+}
+
+bool SerializedResponseCache::GetHeaders(const uint256& start, const uint256& stop, HeadersRun& run)
+{
+    LOCK(m_mutex);
+    const HeadersRun* cached = m_headers.Get(std::make_pair(start, stop));
+    if (!cached) return false;
+    run = *cached;
+    return true;
+}
+
+void SerializedResponseCache::AddHeaders(const uint256& start, const uint256& stop, const CBlockIndex* last, int count, std::vector<unsigned char> payload)
+{
+    HeadersRun run;
+    run.payload = std::make_shared<const std::vector<unsigned char>>(std::move(payload));
+    run.last = last;
+    run.count = count;
+    LOCK(m_mutex);
+    m_headers.Put(std::make_pair(start, stop), std::move(run));
+}
+
+SerializedResponseCache::Payload SerializedResponseCache::GetBlock(const uint256& hash, bool witness)
+{
+    LOCK(m_mutex);
+    const Payload* cached = m_blocks.Get(std::make_pair(hash, witness));
+    return cached ? *cached : nullptr;
+}
+
+void SerializedResponseCache::AddBlock(const uint256& hash, bool witness, std::vector<unsigned char> payload)
+{
+    Payload shared = std::make_shared<const std::vector<unsigned char>>(std::move(payload));
+    LOCK(m_mutex);
+    m_blocks.Put(std::make_pair(hash, witness), std::move(shared));
+}
+
+void SerializedResponseCache::Clear()
+{
+    LOCK(m_mutex);
+    m_headers.Clear();
+    m_blocks.Clear();
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef AURORACOIN_NODE_RESPONSECACHE_H
+#define AURORACOIN_NODE_RESPONSECACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+class CBlockIndex;
+
+/** Header runs kept serialized for getheaders. */
+static const size_t MAX_CACHED_HEADER_RUNS = 16;
+/** Blocks kept serialized for getdata, in each of the with and without witness flavours. */
+static const size_t MAX_CACHED_BLOCKS = 6;
+
+/**
+ * Serialized payloads of the responses peers ask for most: the headers that
+ * follow a given fork point, which every peer syncing from the same place
+ * wants, and the blocks at the tip, which every peer wants right after a
+ * block is found. A hit is sent with a single copy instead of walking the
+ * block index or reading and serializing the block again.
+ *
+ * The cache does not know about the chain; callers check that a header run
+ * still follows the active chain before sending it.
+ */
+class SerializedResponseCache
+{
+public:
+    using Payload = std::shared_ptr<const std::vector<unsigned char>>;
+
+    struct HeadersRun {
+        Payload payload;
+        //! last header in the run
+        const CBlockIndex* last{nullptr};
+        int count{0};
+    };
+
+    explicit SerializedResponseCache(size_t max_header_runs = MAX_CACHED_HEADER_RUNS, size_t max_blocks = MAX_CACHED_BLOCKS);
+
+    /** The headers response for a run starting at start and ending at or before stop. */
+    bool GetHeaders(const uint256& start, const uint256& stop, HeadersRun& run);
+    void AddHeaders(const uint256& start, const uint256& stop, const CBlockIndex* last, int count, std::vector<unsigned char> payload);
+
+    /** The block response, with or without witness data; null if not cached. */
+    Payload GetBlock(const uint256& hash, bool witness);
+    void AddBlock(const uint256& hash, bool witness, std::vector<unsigned char> payload);
+
+    void Clear();
+
+private:
+    /** Least recently used entries are evicted first. */
+    template <typename Key, typename Value>
+    class LruMap
+    {
+    public:
+        explicit LruMap(size_t max_size) : m_max_size(max_size) {}
+
+        const Value* Get(const Key& key)
+        {
+            auto it = m_index.find(key);
+            if (it == m_index.end()) return nullptr;
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            return &it->second->second;
+        }
+
+        void Put(const Key& key, Value value)
+        {
+            auto it = m_index.find(key);
+            if (it != m_index.end()) {
+                it->second->second = std::move(value);
+                m_entries.splice(m_entries.begin(), m_entries, it->second);
+                return;
+            }
+            m_entries.emplace_front(key, std::move(value));
+            m_index.emplace(key, m_entries.begin());
+            if (m_entries.size() > m_max_size) {
+                m_index.erase(m_entries.back().first);
+                m_entries.pop_back();
+            }
+        }
+
+        void Clear()
+        {
+            m_index.clear();
+            m_entries.clear();
+        }
+
+    private:
+        const size_t m_max_size;
+        std::list<std::pair<Key, Value>> m_entries;
+        std::map<Key, typename std::list<std::pair<Key, Value>>::iterator> m_index;
+    };
+
+    Mutex m_mutex;
+    //! keyed by the first header and the peer's stop hash
+    LruMap<std::pair<uint256, uint256>, HeadersRun> m_headers GUARDED_BY(m_mutex);
+    //! keyed by block hash and whether witness data is included
+    LruMap<std::pair<uint256, bool>, Payload> m_blocks GUARDED_BY(m_mutex);
+};
+
+#endif // AURORACOIN_NODE_RESPONSECACHE_H
@@ -12,7 +12,9 @@
 #include <validationinterface.h>
 #include <node/transaction.h>
 
+#include <algorithm>
 #include <future>
+#include <map>
 
 TransactionError BroadcastTransaction(const CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback)
 {
@@ -84,4 +86,85 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, std::string& err
     }
 
     return TransactionError::OK;
-}
\ No newline at end of file
+}
+std::vector<TransactionError> BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<std::string>& err_strings, const std::vector<CAmount>& max_tx_fees, bool relay, bool wait_callback)
+{
+    assert(g_connman);
+    std::promise<void> promise;
+    bool callback_set = false;
+    std::vector<TransactionError> errors(txs.size(), TransactionError::OK);
+    err_strings.assign(txs.size(), std::string());
+    std::map<uint256, size_t> first_copy;
+
+    { // cs_main scope
+    LOCK(cs_main);
+    // Transactions already confirmed or in the mempool are not submitted again,
+    // and a transaction repeated in the batch gets the result of its first copy.
+    CCoinsViewCache &view = ::ChainstateActive().CoinsTip();
+    std::vector<std::pair<size_t, size_t>> repeated;
+    std::vector<size_t> submit;
+    std::vector<CTransactionRef> submit_txs;
+    std::vector<CAmount> submit_fees;
+    for (size_t i = 0; i < txs.size(); i++) {
+        const uint256 hashTx = txs[i]->GetHash();
+        auto inserted = first_copy.emplace(hashTx, i);
+        if (!inserted.second) {
+            repeated.emplace_back(i, inserted.first->second);
+            continue;
+        }
+        bool in_chain = false;
+        for (size_t o = 0; o < txs[i]->vout.size() && !in_chain; o++) {
+            in_chain = !view.AccessCoin(COutPoint(hashTx, o)).IsSpent();
+        }
+        if (in_chain) {
+            errors[i] = TransactionError::ALREADY_IN_CHAIN;
+        } else if (!mempool.exists(hashTx)) {
+            submit.push_back(i);
+            submit_txs.push_back(txs[i]);
+            submit_fees.push_back(max_tx_fees[i]);
+        }
+    }
+
+    std::vector<CValidationState> states;
+    std::vector<bool> missing_inputs;
+    const std::vector<bool> accepted = AcceptToMemoryPoolBatch(mempool, submit_txs, submit_fees, states, missing_inputs);
+    for (size_t j = 0; j < submit.size(); j++) {
+        const size_t i = submit[j];
+        if (accepted[j]) continue;
+        if (states[j].IsInvalid()) {
+            err_strings[i] = FormatStateMessage(states[j]);
+            errors[i] = TransactionError::MEMPOOL_REJECTED;
+        } else if (missing_inputs[j]) {
+            errors[i] = TransactionError::MISSING_INPUTS;
+        } else {
+            err_strings[i] = FormatStateMessage(states[j]);
+            errors[i] = TransactionError::MEMPOOL_ERROR;
+        }
+    }
+    for (const auto& copy : repeated) {
+        errors[copy.first] = errors[copy.second];
+        err_strings[copy.first] = err_strings[copy.second];
+    }
+
+    if (wait_callback && std::find(accepted.begin(), accepted.end(), true) != accepted.end()) {
+        // See BroadcastTransaction: one callback covers every transaction of the batch.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+        callback_set = true;
+    }
+
+    } // cs_main
+
+    if (callback_set) {
+        promise.get_future().wait();
+    }
+
+    if (relay) {
+        for (const auto& tx : first_copy) {
+            if (errors[tx.second] == TransactionError::OK) RelayTransaction(tx.first, *g_connman);
+        }
+    }
+
+    return errors;
+}
@@ -10,6 +10,9 @@
 #include <uint256.h>
 #include <util/error.h>
 
+#include <string>
+#include <vector>
+
 #define TRANSACTION_ERR_LAST TransactionError::ERROR_COUNT
 
 /**
@@ -30,4 +33,19 @@
  */
 NODISCARD TransactionError BroadcastTransaction(CTransactionRef tx, std::string& err_string, const CAmount& max_tx_fee, bool relay, bool wait_callback);
 
+/**
+ * Submit several transactions to the mempool and (optionally) relay them, with
+ * the same results as calling BroadcastTransaction for each, but validating
+ * the whole batch under one acquisition of cs_main. Transactions may spend
+ * outputs of others in the batch, in any order.
+ *
+ * @param[in]  txs the transactions to broadcast
+ * @param[out] &err_strings filled with an error string for each transaction, empty if not available
+ * @param[in]  max_tx_fees reject a tx with fees higher than its entry here (if 0, accept any fee)
+ * @param[in]  relay flag if both mempool insertion and p2p relay are requested
+ * @param[in]  wait_callback, wait until callbacks have been processed to avoid stale result due to a sequentially RPC.
+ * return the error for each transaction
+ */
+NODISCARD std::vector<TransactionError> BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<std::string>& err_strings, const std::vector<CAmount>& max_tx_fees, bool relay, bool wait_callback);
+
 #endif // AURORACOIN_NODE_TRANSACTION_H
\ No newline at end of file
@@ -0,0 +1,223 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <pinsketch.h>
+#include <random.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+/** Tag mixed into the short ID keys, so they differ from any other use of the salts. */
+static const std::string RECON_SALT_TAG = "Tx Relay Salting";
+
+uint32_t TxReconciliationTracker::PeerState::ShortId(const uint256& txid) const
+{
+    // Zero cannot be added to a sketch.
+    const uint32_t short_id = SipHashUint256(m_k0, m_k1, txid);
+    return short_id == 0 ? 1 : short_id;
+}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer_id)
+{
+    const uint64_t local_salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(m_mutex);
+    m_local_salts[peer_id] = local_salt;
+    return local_salt;
+}
+
+TxReconciliationTracker::RegisterResult TxReconciliationTracker::RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_recon_version, uint64_t remote_salt)
+{
+    LOCK(m_mutex);
+    auto salt_it = m_local_salts.find(peer_id);
+    if (salt_it == m_local_salts.end()) {
+        return m_states.count(peer_id) ? RegisterResult::ALREADY_REGISTERED : RegisterResult::NOT_FOUND;
+    }
+    // Version 1 is the only one there is; later versions must stay compatible with it.
+    if (peer_recon_version < TXRECONCILIATION_PROTOCOL_VERSION) return RegisterResult::PROTOCOL_VIOLATION;
+
+    const uint64_t local_salt = salt_it->second;
+    m_local_salts.erase(salt_it);
+
+    // Both sides hash the salts in the same order, so they agree on the keys.
+    CHashWriter hasher(SER_GETHASH, 0);
+    hasher << RECON_SALT_TAG << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt);
+    const uint256 full_salt = hasher.GetHash();
+
+    PeerState state;
+    state.m_k0 = full_salt.GetUint64(0);
+    state.m_k1 = full_salt.GetUint64(1);
+    state.m_we_initiate = !is_peer_inbound;
+    size_t flood_to_count = 0;
+    for (const auto& entry : m_states) {
+        if (entry.second.m_flood_to) flood_to_count++;
+    }
+    state.m_flood_to = !is_peer_inbound && flood_to_count < MAX_OUTBOUND_FLOOD_TO;
+    m_states.emplace(peer_id, std::move(state));
+    return RegisterResult::SUCCESS;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer_id)
+{
+    LOCK(m_mutex);
+    m_local_salts.erase(peer_id);
+    m_states.erase(peer_id);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer_id) const
+{
+    LOCK(m_mutex);
+    return m_states.count(peer_id) > 0;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer_id, const uint256& txid)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end() || it->second.m_flood_to) return false;
+    if (it->second.m_local_set.size() >= MAX_RECON_SET_SIZE) return false;
+    it->second.m_local_set.insert(txid);
+    return true;
+}
+
+void TxReconciliationTracker::TryRemovingFromSet(NodeId peer_id, const uint256& txid)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return;
+    // The snapshot of a running round is left alone: both sides have already
+    // built their sketches from it.
+    it->second.m_local_set.erase(txid);
+}
+
+bool TxReconciliationTracker::InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now, uint16_t& local_set_size, uint16_t& local_q)
+{
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (!state.m_we_initiate || state.m_round_pending || now < state.m_next_request) return false;
+
+    state.m_round_set.swap(state.m_local_set);
+    state.m_local_set.clear();
+    state.m_round_pending = true;
+    state.m_next_request = now + RECON_REQUEST_INTERVAL;
+    local_set_size = state.m_round_set.size();
+    local_q = RECON_Q * RECON_Q_PRECISION;
+    return true;
+}
+
+uint32_t TxReconciliationTracker::EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q)
+{
+    // The difference is at least the difference in size; q estimates how many
+    // of the smaller set are new to the other side as well.
+    const size_t set_size_diff = std::max(local_set_size, remote_set_size) - std::min(local_set_size, remote_set_size);
+    const size_t min_size = std::min(local_set_size, remote_set_size);
+    const double estimate = set_size_diff + double(q) / RECON_Q_PRECISION * min_size;
+    return uint32_t(std::min<double>(std::ceil(estimate), MAX_SKETCH_CAPACITY + 1)) + 1;
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(NodeId peer_id, uint16_t remote_set_size, uint16_t remote_q, std::vector<unsigned char>& sketch)
+{
+    sketch.clear();
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (state.m_we_initiate || state.m_round_pending) return false;
+
+    state.m_round_set.swap(state.m_local_set);
+    state.m_local_set.clear();
+    state.m_round_pending = true;
+
+    const uint32_t capacity = EstimateSketchCapacity(state.m_round_set.size(), remote_set_size, remote_q);
+    // An empty sketch tells the initiator to give up on this round.
+    if (capacity > MAX_SKETCH_CAPACITY) return true;
+
+    PinSketch local_sketch(capacity);
+    for (const uint256& txid : state.m_round_set) {
+        local_sketch.Add(state.ShortId(txid));
+    }
+    sketch = local_sketch.Serialize();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer_id, const std::vector<unsigned char>& sketch, bool& success, std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce)
+{
+    success = false;
+    ask_shortids.clear();
+    announce.clear();
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (!state.m_we_initiate || !state.m_round_pending) return false;
+
+    PinSketch remote_sketch;
+    if (sketch.size() > MAX_SKETCH_CAPACITY * 4 || !PinSketch::Deserialize(sketch, remote_sketch)) return false;
+
+    const uint32_t capacity = remote_sketch.GetCapacity();
+    std::vector<uint32_t> difference;
+    if (capacity > 0) {
+        std::unordered_map<uint32_t, uint256> local_short_ids;
+        PinSketch local_sketch(capacity);
+        for (const uint256& txid : state.m_round_set) {
+            const uint32_t short_id = state.ShortId(txid);
+            local_short_ids.emplace(short_id, txid);
+            local_sketch.Add(short_id);
+        }
+        remote_sketch.Merge(local_sketch);
+        // One syndrome is kept in reserve, so a difference that overflowed the
+        // sketch is not mistaken for a smaller one.
+        if (remote_sketch.Decode(difference) && difference.size() < capacity) {
+            success = true;
+            for (uint32_t short_id : difference) {
+                auto local_it = local_short_ids.find(short_id);
+                if (local_it != local_short_ids.end()) {
+                    announce.push_back(local_it->second);
+                } else {
+                    ask_shortids.push_back(short_id);
+                }
+            }
+        }
+    }
+    if (!success) {
+        announce.assign(state.m_round_set.begin(), state.m_round_set.end());
+    }
+    state.m_round_set.clear();
+    state.m_round_pending = false;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce)
+{
+    announce.clear();
+    LOCK(m_mutex);
+    auto it = m_states.find(peer_id);
+    if (it == m_states.end()) return false;
+    PeerState& state = it->second;
+    if (state.m_we_initiate || !state.m_round_pending) return false;
+
+    if (success) {
+        if (ask_shortids.size() > MAX_SKETCH_CAPACITY) return false;
+        std::unordered_map<uint32_t, uint256> local_short_ids;
+        for (const uint256& txid : state.m_round_set) {
+            local_short_ids.emplace(state.ShortId(txid), txid);
+        }
+        for (uint32_t short_id : ask_shortids) {
+            auto local_it = local_short_ids.find(short_id);
+            if (local_it != local_short_ids.end()) announce.push_back(local_it->second);
+        }
+    } else {
+        announce.assign(state.m_round_set.begin(), state.m_round_set.end());
+    }
+    state.m_round_set.clear();
+    state.m_round_pending = false;
+    return true;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef AURORACOIN_NODE_TXRECONCILIATION_H
+#define AURORACOIN_NODE_TXRECONCILIATION_H
+
+#include <net.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <set>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/** Whether transaction reconciliation is offered to peers by default */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol announced in sendtxrcncl */
+static const uint32_t TXRECONCILIATION_PROTOCOL_VERSION = 1;
+/** Interval between reconciliation requests to each peer we initiate with */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{8};
+/** Number of outbound reconciliation peers that still get transactions flooded to them */
+static const size_t MAX_OUTBOUND_FLOOD_TO = 2;
+/** Transactions queued for one peer beyond this are flooded to it instead */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/**
+ * Largest sketch we build or accept. Decoding cost grows with the square of
+ * the capacity; rounds needing more fall back to announcing by inv.
+ */
+static const uint32_t MAX_SKETCH_CAPACITY = 64;
+/** Coefficient q of the set difference estimate, and its fixed point scale on the wire */
+static constexpr double RECON_Q = 0.25;
+static const uint16_t RECON_Q_PRECISION = (1 << 15) - 1;
+
+/**
+ * Erlay-style set reconciliation of transaction announcements (BIP 330).
+ *
+ * Instead of an inv per transaction, a transaction is added to the set of
+ * every reconciling peer. The side that opened the connection periodically
+ * asks the other for a PinSketch of its set (reqrecon), sends back which of
+ * the short IDs in the difference it is missing (reconcildiff) and announces
+ * the ones the peer is missing, so each transaction is announced roughly once
+ * per link. A few outbound peers still get transactions flooded to them to
+ * keep propagation fast. When a sketch cannot be decoded, both sides announce
+ * their whole set by inv.
+ *
+ * Everything here is keyed by NodeId and guarded by its own lock, so the
+ * message handlers can call it without cs_main.
+ */
+class TxReconciliationTracker
+{
+public:
+    enum class RegisterResult {
+        SUCCESS,
+        NOT_FOUND,          //!< we never offered reconciliation to this peer
+        ALREADY_REGISTERED,
+        PROTOCOL_VIOLATION,
+    };
+
+    /** Remember that we offer reconciliation to the peer; returns the salt to send in sendtxrcncl. */
+    uint64_t PreRegisterPeer(NodeId peer_id);
+    /** Handle the peer's sendtxrcncl; on success the peer reconciles from now on. */
+    RegisterResult RegisterPeer(NodeId peer_id, bool is_peer_inbound, uint32_t peer_recon_version, uint64_t remote_salt);
+    void ForgetPeer(NodeId peer_id);
+    bool IsPeerRegistered(NodeId peer_id) const;
+
+    /**
+     * Queue a transaction for the next reconciliation with the peer. Returns
+     * false if it should be announced by inv instead: the peer does not
+     * reconcile, is one of the outbound peers we flood to, or its set is full.
+     */
+    bool AddToSet(NodeId peer_id, const uint256& txid);
+    /** The peer announced the transaction itself, so it need not be reconciled. */
+    void TryRemovingFromSet(NodeId peer_id, const uint256& txid);
+
+    /**
+     * If we initiate with the peer and a request is due, start a round and
+     * return the values to send in reqrecon.
+     */
+    bool InitiateReconciliationRequest(NodeId peer_id, std::chrono::microseconds now, uint16_t& local_set_size, uint16_t& local_q);
+    /** Responder: answer a reqrecon with a sketch of our set. Returns false on a protocol violation. */
+    bool HandleReconciliationRequest(NodeId peer_id, uint16_t remote_set_size, uint16_t remote_q, std::vector<unsigned char>& sketch);
+    /**
+     * Initiator: decode the difference between the peer's sketch and our
+     * set. Fills what to send in reconcildiff and the transactions to
+     * announce to the peer. Returns false on a protocol violation.
+     */
+    bool HandleSketch(NodeId peer_id, const std::vector<unsigned char>& sketch, bool& success, std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce);
+    /** Responder: finish the round; fills the transactions to announce. Returns false on a protocol violation. */
+    bool HandleReconciliationDifference(NodeId peer_id, bool success, const std::vector<uint32_t>& ask_shortids, std::vector<uint256>& announce);
+
+    /** Sketch capacity for reconciling sets of the given sizes, including one check syndrome. */
+    static uint32_t EstimateSketchCapacity(size_t local_set_size, size_t remote_set_size, uint16_t q);
+
+private:
+    struct PeerState {
+        //! SipHash keys for short IDs, derived from both sides' salts
+        uint64_t m_k0;
+        uint64_t m_k1;
+        //! whether we send the reqrecon messages (we opened the connection)
+        bool m_we_initiate;
+        //! whether transactions are flooded to this peer rather than reconciled
+        bool m_flood_to;
+        //! transactions for the next round
+        std::set<uint256> m_local_set;
+        //! snapshot of m_local_set taken when the current round started
+        std::set<uint256> m_round_set;
+        //! initiator: reqrecon sent; responder: sketch sent
+        bool m_round_pending{false};
+        std::chrono::microseconds m_next_request{0};
+
+        uint32_t ShortId(const uint256& txid) const;
+    };
+
+    mutable Mutex m_mutex;
+    //! salts we sent to peers that have not answered with sendtxrcncl yet
+    std::unordered_map<NodeId, uint64_t> m_local_salts GUARDED_BY(m_mutex);
+    std::unordered_map<NodeId, PeerState> m_states GUARDED_BY(m_mutex);
+};
+
+#endif // AURORACOIN_NODE_TXRECONCILIATION_H
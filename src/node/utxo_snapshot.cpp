@@ -0,0 +1,127 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <node/coinstats.h>
+#include <streams.h>
+#include <tinyformat.h>
+#include <util/system.h>
+
+#include <map>
+
+constexpr char SnapshotMetadata::MAGIC[5];
+
+static void WriteSnapshotTx(CAutoFile& file, const uint256& txid, const std::map<uint32_t, Coin>& outputs)
+{
+    file << txid;
+    file << VARINT((uint64_t)outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+}
+
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, CAutoFile& file, SnapshotMetadata& metadata)
+{
+    // Reserve room for the header; it is rewritten once the count and hash are known.
+    const long header_pos = ftell(file.Get());
+    if (header_pos < 0) {
+        return error("%s: unable to determine file position", __func__);
+    }
+    metadata = SnapshotMetadata();
+    metadata.m_base_blockhash = cursor.GetBestBlock();
+    file << metadata;
+
+    CCoinsStats stats;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata.m_base_blockhash;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (cursor.Valid()) {
+        COutPoint key;
+        Coin coin;
+        if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+            return error("%s: unable to read value", __func__);
+        }
+        if (!outputs.empty() && key.hash != prevkey) {
+            ApplyStats(stats, ss, prevkey, outputs);
+            WriteSnapshotTx(file, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = std::move(coin);
+        cursor.Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+        WriteSnapshotTx(file, prevkey, outputs);
+    }
+
+    metadata.m_coins_count = stats.nTransactionOutputs;
+    metadata.m_utxo_hash = ss.GetHash();
+    if (fseek(file.Get(), header_pos, SEEK_SET) != 0) {
+        return error("%s: unable to rewind to the snapshot header", __func__);
+    }
+    file << metadata;
+    return fseek(file.Get(), 0, SEEK_END) == 0;
+}
+
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata,
+    const std::function<void(const COutPoint&, Coin&&)>& add_coin, std::string& error)
+{
+    CCoinsStats stats;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata.m_base_blockhash;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    try {
+        while (stats.nTransactionOutputs < metadata.m_coins_count) {
+            uint256 txid;
+            uint64_t count;
+            file >> txid;
+            file >> VARINT(count);
+            // The writer emits transactions in cursor (txid) order, so any
+            // repeated or out of order txid means the file was tampered with.
+            if (stats.nTransactions > 0 && !(prevkey < txid)) {
+                error = strprintf("transaction %s out of order", txid.ToString());
+                return false;
+            }
+            if (count == 0 || count > metadata.m_coins_count - stats.nTransactionOutputs) {
+                error = strprintf("bad output count for transaction %s", txid.ToString());
+                return false;
+            }
+            outputs.clear();
+            for (uint64_t i = 0; i < count; ++i) {
+                uint32_t n;
+                Coin coin;
+                file >> VARINT(n);
+                file >> coin;
+                if (coin.IsSpent() || (!outputs.empty() && n <= outputs.rbegin()->first)) {
+                    error = strprintf("bad output %s:%u", txid.ToString(), n);
+                    return false;
+                }
+                outputs.emplace_hint(outputs.end(), n, std::move(coin));
+            }
+            ApplyStats(stats, ss, txid, outputs);
+            prevkey = txid;
+            if (add_coin) {
+                for (auto& output : outputs) {
+                    add_coin(COutPoint(txid, output.first), std::move(output.second));
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("unable to read coins: %s", e.what());
+        return false;
+    }
+
+    if (ss.GetHash() != metadata.m_utxo_hash) {
+        error = strprintf("UTXO set hash mismatch: expected %s, got %s", metadata.m_utxo_hash.ToString(), ss.GetHash().ToString());
+        return false;
+    }
+    return true;
+}
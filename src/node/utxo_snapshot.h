@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef AURORACOIN_NODE_UTXO_SNAPSHOT_H
+#define AURORACOIN_NODE_UTXO_SNAPSHOT_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ios>
+#include <string>
+
+class CAutoFile;
+class CCoinsViewCursor;
+class COutPoint;
+class Coin;
+
+/** Current UTXO snapshot file format version */
+static const uint16_t UTXO_SNAPSHOT_VERSION = 1;
+
+/**
+ * Header of a UTXO snapshot file, as written by dumptxoutset.
+ *
+ * The header has a fixed size so the writer can reserve room for it and fill
+ * in the coin count and commitment once the whole set has been streamed out.
+ * It is followed by the coins grouped per transaction in txid order: the txid,
+ * the number of unspent outputs and then each output index with its Coin.
+ */
+class SnapshotMetadata
+{
+public:
+    //! Hash of the block the UTXO set was taken at.
+    uint256 m_base_blockhash;
+
+    //! Number of unspent outputs in the snapshot.
+    uint64_t m_coins_count = 0;
+
+    //! Commitment to the UTXO set; the same value gettxoutsetinfo reports as
+    //! hash_serialized_2 at m_base_blockhash.
+    uint256 m_utxo_hash;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write(MAGIC, sizeof(MAGIC));
+        s << UTXO_SNAPSHOT_VERSION << m_base_blockhash << m_coins_count << m_utxo_hash;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char magic[sizeof(MAGIC)];
+        s.read(magic, sizeof(magic));
+        if (memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::ios_base::failure("Not a UTXO snapshot file");
+        }
+        uint16_t version;
+        s >> version;
+        if (version != UTXO_SNAPSHOT_VERSION) {
+            throw std::ios_base::failure("Unsupported UTXO snapshot version");
+        }
+        s >> m_base_blockhash >> m_coins_count >> m_utxo_hash;
+    }
+
+private:
+    static constexpr char MAGIC[5] = {'u', 't', 'x', 'o', '\xff'};
+};
+
+/**
+ * Stream the coins under `cursor` to `file`, starting with the header. The
+ * snapshot is based on the cursor's best block. On success `metadata`
+ * describes what was written.
+ */
+bool WriteUTXOSnapshot(CCoinsViewCursor& cursor, CAutoFile& file, SnapshotMetadata& metadata);
+
+/**
+ * Read the coins that follow `metadata` in `file`, passing each of them to
+ * `add_coin` (when set) in file order. Fails on malformed input or when the
+ * coins do not match the count and commitment in the header.
+ */
+bool ReadUTXOSnapshot(CAutoFile& file, const SnapshotMetadata& metadata,
+    const std::function<void(const COutPoint&, Coin&&)>& add_coin, std::string& error);
+
+#endif // AURORACOIN_NODE_UTXO_SNAPSHOT_H
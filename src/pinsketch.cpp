@@ -0,0 +1,272 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <utility>
+
+namespace {
+
+// GF(2^32) is represented as GF(2)[x] / (x^32 + x^7 + x^3 + x^2 + 1).
+
+/** How many trace maps to try before giving up on splitting a polynomial. */
+constexpr int MAX_SPLIT_ATTEMPTS = 64;
+
+uint32_t Mul(uint32_t a, uint32_t b)
+{
+    // Carry-less multiplication, four bits of b at a time
+    uint64_t table[16];
+    table[0] = 0;
+    for (int i = 1; i < 16; i++) {
+        table[i] = (table[i >> 1] << 1) ^ ((i & 1) ? a : 0);
+    }
+    uint64_t r = 0;
+    for (int shift = 28; shift >= 0; shift -= 4) {
+        r = (r << 4) ^ table[(b >> shift) & 15];
+    }
+    // Reduce: x^32 = x^7 + x^3 + x^2 + 1, folding twice as the first fold can carry past bit 32
+    for (int i = 0; i < 2; i++) {
+        const uint64_t high = r >> 32;
+        r = (r & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    }
+    return r;
+}
+
+uint32_t Sqr(uint32_t a) { return Mul(a, a); }
+
+/** a^(2^32 - 2), the inverse of a non-zero a. */
+uint32_t Inv(uint32_t a)
+{
+    assert(a != 0);
+    uint32_t r = a;
+    for (int i = 0; i < 30; i++) r = Mul(Sqr(r), a);
+    return Sqr(r);
+}
+
+/** Polynomial over GF(2^32), lowest degree first, without trailing zeroes. */
+typedef std::vector<uint32_t> Poly;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0) p.pop_back();
+}
+
+/** Reduce a modulo m, returning the quotient if requested. */
+void DivMod(Poly& a, const Poly& m, Poly* quotient = nullptr)
+{
+    assert(!m.empty());
+    Trim(a);
+    if (quotient) quotient->assign(a.size() >= m.size() ? a.size() - m.size() + 1 : 0, 0);
+    const uint32_t lead_inv = Inv(m.back());
+    while (a.size() >= m.size()) {
+        const uint32_t factor = Mul(a.back(), lead_inv);
+        const size_t shift = a.size() - m.size();
+        if (quotient) (*quotient)[shift] = factor;
+        for (size_t i = 0; i < m.size(); i++) {
+            a[shift + i] ^= Mul(factor, m[i]);
+        }
+        Trim(a);
+    }
+}
+
+/**
+ * x^(2i) mod f for every i below the degree of f. Squaring is linear in
+ * characteristic 2, so with this table a polynomial can be squared modulo f
+ * without a division.
+ */
+std::vector<Poly> SquareTable(const Poly& f)
+{
+    std::vector<Poly> table(f.size() - 1);
+    Poly power{1};
+    for (Poly& entry : table) {
+        entry = power;
+        power.insert(power.begin(), 2, 0);
+        DivMod(power, f);
+    }
+    return table;
+}
+
+/** a^2 mod f, for a already reduced modulo f. */
+Poly SqrMod(const Poly& a, const std::vector<Poly>& table)
+{
+    assert(a.size() <= table.size());
+    Poly r;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] == 0) continue;
+        const uint32_t square = Sqr(a[i]);
+        const Poly& power = table[i];
+        if (r.size() < power.size()) r.resize(power.size(), 0);
+        for (size_t j = 0; j < power.size(); j++) {
+            r[j] ^= Mul(square, power[j]);
+        }
+    }
+    Trim(r);
+    return r;
+}
+
+Poly GCD(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        DivMod(a, b);
+        std::swap(a, b);
+    }
+    return a;
+}
+
+/**
+ * Find the roots of f, which must be a product of distinct linear factors,
+ * by splitting it with gcd(f, Tr(beta * x)) for varying beta (Berlekamp's
+ * trace algorithm).
+ */
+bool FindRoots(const Poly& f, std::vector<uint32_t>& roots, uint32_t& seed)
+{
+    assert(f.size() >= 2);
+    if (f.size() == 2) {
+        roots.push_back(Mul(f[0], Inv(f[1])));
+        return true;
+    }
+    const std::vector<Poly> table = SquareTable(f);
+    for (int attempt = 0; attempt < MAX_SPLIT_ATTEMPTS; attempt++) {
+        // xorshift32; any non-zero sequence of betas will do
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        Poly term{0, seed};
+        Poly trace = term;
+        for (int i = 1; i < 32; i++) {
+            term = SqrMod(term, table);
+            if (trace.size() < term.size()) trace.resize(term.size(), 0);
+            for (size_t j = 0; j < term.size(); j++) trace[j] ^= term[j];
+        }
+        Trim(trace);
+        Poly g = GCD(f, trace);
+        if (g.size() > 1 && g.size() < f.size()) {
+            Poly rest = f;
+            Poly h;
+            DivMod(rest, g, &h);
+            if (!rest.empty()) return false;
+            return FindRoots(g, roots, seed) && FindRoots(h, roots, seed);
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element)
+{
+    assert(element != 0);
+    const uint32_t square = Sqr(element);
+    uint32_t power = element;
+    for (uint32_t& syndrome : m_syndromes) {
+        syndrome ^= power;
+        power = Mul(power, square);
+    }
+}
+
+void PinSketch::Merge(const PinSketch& other)
+{
+    assert(other.m_syndromes.size() == m_syndromes.size());
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        m_syndromes[i] ^= other.m_syndromes[i];
+    }
+}
+
+std::vector<unsigned char> PinSketch::Serialize() const
+{
+    std::vector<unsigned char> data(m_syndromes.size() * 4);
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        WriteLE32(data.data() + 4 * i, m_syndromes[i]);
+    }
+    return data;
+}
+
+bool PinSketch::Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch)
+{
+    if (data.size() % 4 != 0) return false;
+    sketch.m_syndromes.resize(data.size() / 4);
+    for (size_t i = 0; i < sketch.m_syndromes.size(); i++) {
+        sketch.m_syndromes[i] = ReadLE32(data.data() + 4 * i);
+    }
+    return true;
+}
+
+bool PinSketch::Decode(std::vector<uint32_t>& elements) const
+{
+    elements.clear();
+    const size_t capacity = m_syndromes.size();
+
+    // Power sums S_1 .. S_2c (1-based); in characteristic 2, S_2k = S_k^2.
+    std::vector<uint32_t> sums(2 * capacity + 1, 0);
+    for (size_t i = 1; i <= 2 * capacity; i++) {
+        sums[i] = (i & 1) ? m_syndromes[i / 2] : Sqr(sums[i / 2]);
+    }
+
+    // Berlekamp-Massey: find the shortest recurrence generating the sums,
+    // which is the polynomial whose roots are the inverses of the elements.
+    Poly locator{1};
+    Poly prev{1};
+    size_t degree = 0;
+    size_t shift = 1;
+    uint32_t prev_discrepancy = 1;
+    for (size_t n = 0; n < 2 * capacity; n++) {
+        uint32_t discrepancy = sums[n + 1];
+        for (size_t i = 1; i <= degree && i < locator.size(); i++) {
+            discrepancy ^= Mul(locator[i], sums[n + 1 - i]);
+        }
+        if (discrepancy == 0) {
+            shift++;
+            continue;
+        }
+        const uint32_t factor = Mul(discrepancy, Inv(prev_discrepancy));
+        const Poly saved = locator;
+        if (locator.size() < prev.size() + shift) locator.resize(prev.size() + shift, 0);
+        for (size_t i = 0; i < prev.size(); i++) {
+            locator[i + shift] ^= Mul(factor, prev[i]);
+        }
+        if (2 * degree <= n) {
+            degree = n + 1 - degree;
+            prev = saved;
+            prev_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    Trim(locator);
+    if (degree > capacity || locator.size() != degree + 1) return false;
+    if (degree == 0) return true;
+
+    // The reversed locator has the elements themselves as roots.
+    Poly poly(locator.rbegin(), locator.rend());
+
+    // It must split into distinct linear factors, i.e. divide x^(2^32) - x.
+    if (degree > 1) {
+        const std::vector<Poly> table = SquareTable(poly);
+        Poly x{0, 1};
+        Poly power = x;
+        for (int i = 0; i < 32; i++) power = SqrMod(power, table);
+        if (power != x) return false;
+    }
+
+    std::vector<uint32_t> roots;
+    uint32_t seed = 0x9e3779b9;
+    if (!FindRoots(poly, roots, seed) || roots.size() != degree) return false;
+
+    // Guard against a decoding that only happens to fit.
+    PinSketch check(capacity);
+    for (uint32_t root : roots) {
+        if (root == 0) return false;
+        check.Add(root);
+    }
+    if (!(check == *this)) return false;
+
+    elements = std::move(roots);
+    return true;
+}
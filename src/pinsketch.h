@@ -0,0 +1,51 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef AURORACOIN_PINSKETCH_H
+#define AURORACOIN_PINSKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * PinSketch set sketch over GF(2^32), as used for transaction reconciliation.
+ *
+ * A sketch of capacity c holds the odd power sums x, x^3, ..., x^(2c-1) of the
+ * non-zero 32-bit elements added to it, 4 bytes per unit of capacity. Adding
+ * an element twice removes it again, so merging the sketches of two sets
+ * gives the sketch of their symmetric difference, which can be decoded as
+ * long as it has at most c elements.
+ */
+class PinSketch
+{
+public:
+    explicit PinSketch(uint32_t capacity = 0) : m_syndromes(capacity, 0) {}
+
+    uint32_t GetCapacity() const { return m_syndromes.size(); }
+
+    /** Add (or, if present, remove) a non-zero element. */
+    void Add(uint32_t element);
+
+    /** Combine with another sketch of the same capacity. */
+    void Merge(const PinSketch& other);
+
+    /** Serialized form: every power sum as 4 little-endian bytes. */
+    std::vector<unsigned char> Serialize() const;
+    /** Parse a serialized sketch; fails if the size is not a multiple of 4. */
+    static bool Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch);
+
+    /**
+     * Recover the elements of the sketch. Returns false if it holds more than
+     * the capacity allows, in which case the result is unusable.
+     */
+    bool Decode(std::vector<uint32_t>& elements) const;
+
+    friend bool operator==(const PinSketch& a, const PinSketch& b) { return a.m_syndromes == b.m_syndromes; }
+
+private:
+    std::vector<uint32_t> m_syndromes;
+};
+
+#endif // AURORACOIN_PINSKETCH_H
@@ -208,6 +208,7 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    std::vector<uint8_t> block_data;
     CBlockIndex* pblockindex = nullptr;
     CBlockIndex* tip = nullptr;
     {
@@ -221,24 +222,34 @@ static bool rest_block(HTTPRequest* req,
         if (IsBlockPruned(pblockindex))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (rf == RetFormat::BINARY || rf == RetFormat::HEX) {
+            if (!ReadRawBlockFromDisk(block_data, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
     }
 
-    switch (rf) {
-    case RetFormat::BINARY: {
+    // The on-disk serialization can be returned as-is unless witness data has to be stripped
+    if ((rf == RetFormat::BINARY || rf == RetFormat::HEX) &&
+        (RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS) && !IsRawBlockWitnessFree(block_data)) {
+        VectorReader(SER_NETWORK, PROTOCOL_VERSION, block_data, 0) >> block;
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
-        std::string binaryBlock = ssBlock.str();
+        block_data.assign(ssBlock.begin(), ssBlock.end());
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        std::string binaryBlock(block_data.begin(), block_data.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RetFormat::HEX: {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(block_data.begin(), block_data.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -12,6 +12,7 @@
 #include <chainparams.h>
 #include <coins.h>
 #include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
@@ -870,6 +871,20 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
     return block;
 }
 
+static std::vector<uint8_t> GetRawBlockChecked(const CBlockIndex* pblockindex)
+{
+    std::vector<uint8_t> block_data;
+    if (IsBlockPruned(pblockindex)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
+    }
+
+    if (!ReadRawBlockFromDisk(block_data, pblockindex, Params().MessageStart())) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+    }
+
+    return block_data;
+}
+
 static CBlockUndo GetUndoChecked(const CBlockIndex* pblockindex)
 {
     CBlockUndo blockUndo;
@@ -951,6 +966,7 @@ static UniValue getblock(const JSONRPCRequest& request)
     }
 
     CBlock block;
+    std::vector<uint8_t> block_data;
     const CBlockIndex* pblockindex;
     const CBlockIndex* tip;
     {
@@ -962,11 +978,20 @@ static UniValue getblock(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
         }
 
-        block = GetBlockChecked(pblockindex);
+        if (verbosity <= 0) {
+            block_data = GetRawBlockChecked(pblockindex);
+        } else {
+            block = GetBlockChecked(pblockindex);
+        }
     }
 
     if (verbosity <= 0)
     {
+        // Serve the on-disk bytes unless witness data has to be stripped
+        if (!(RPCSerializationFlags() & SERIALIZE_TRANSACTION_NO_WITNESS) || IsRawBlockWitnessFree(block_data)) {
+            return HexStr(block_data.begin(), block_data.end());
+        }
+        VectorReader(SER_NETWORK, PROTOCOL_VERSION, block_data, 0) >> block;
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
@@ -2085,6 +2110,127 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"dumptxoutset",
+                "\nWrite the UTXO set at the current tip to a snapshot file that loadtxoutset can bootstrap a node from.\n"
+                "Note this call may take some time.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "Path to the output file. A relative path is taken relative to the data directory."},
+                },
+                RPCResult{
+            "{\n"
+            "  \"coins_written\": n,        (numeric) The number of unspent outputs written\n"
+            "  \"base_hash\": \"hash\",       (string) The hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,          (numeric) The height of the block the snapshot was taken at\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The UTXO set commitment, as reported by gettxoutsetinfo\n"
+            "  \"path\": \"path\"             (string) The absolute path of the snapshot file\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+                },
+            }.Check(request);
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary file first so that an interrupted dump is never
+    // mistaken for a complete snapshot.
+    const fs::path temppath = fs::absolute(request.params[0].get_str() + ".incomplete", GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    CAutoFile afile(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to open " + temppath.string() + " for writing");
+    }
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    int base_height;
+    {
+        // The cursor reads a consistent view of the database, so the tip may
+        // move on once it has been created.
+        LOCK(cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        pcursor.reset(::ChainstateActive().CoinsDB().Cursor());
+        base_height = LookupBlockIndex(pcursor->GetBestBlock())->nHeight;
+    }
+
+    SnapshotMetadata metadata;
+    if (!WriteUTXOSnapshot(*pcursor, afile, metadata) || !FileCommit(afile.Get())) {
+        afile.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write UTXO snapshot");
+    }
+    afile.fclose();
+    if (!RenameOver(temppath, path)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to rename " + temppath.string() + " to " + path.string());
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", metadata.m_coins_count);
+    ret.pushKV("base_hash", metadata.m_base_blockhash.GetHex());
+    ret.pushKV("base_height", base_height);
+    ret.pushKV("hash_serialized_2", metadata.m_utxo_hash.GetHex());
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
+static UniValue loadtxoutset(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"loadtxoutset",
+                "\nBootstrap the chainstate from a UTXO snapshot written by dumptxoutset, making its base block the tip.\n"
+                "The node must run with -prune and still be at the genesis block, and the header of the snapshot base\n"
+                "block must already be known. Blocks below the base are never downloaded or validated; compare the\n"
+                "snapshot hash with gettxoutsetinfo on a node you trust, or pass it as the hash argument.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "Path to the snapshot file. A relative path is taken relative to the data directory."},
+                    {"hash", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "Expected hash_serialized_2 of the snapshot"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"coins_loaded\": n,         (numeric) The number of unspent outputs loaded\n"
+            "  \"tip_hash\": \"hash\",        (string) The hash of the new tip, the snapshot base block\n"
+            "  \"base_height\": n,          (numeric) The height of the snapshot base block\n"
+            "  \"path\": \"path\"             (string) The absolute path of the snapshot file\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("loadtxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("loadtxoutset", "\"utxo.dat\"")
+                },
+            }.Check(request);
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unable to open " + path.string());
+    }
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unable to read snapshot header: %s", e.what()));
+    }
+    if (!request.params[1].isNull() && ParseHashV(request.params[1], "hash") != metadata.m_utxo_hash) {
+        throw JSONRPCError(RPC_VERIFY_ERROR, "Snapshot hash does not match the expected hash");
+    }
+
+    std::string error;
+    if (!::ChainstateActive().LoadUTXOSnapshot(afile, metadata, error)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to load UTXO snapshot: " + error);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_loaded", metadata.m_coins_count);
+    ret.pushKV("tip_hash", metadata.m_base_blockhash.GetHex());
+    ret.pushKV("base_height", WITH_LOCK(cs_main, return LookupBlockIndex(metadata.m_base_blockhash)->nHeight));
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -2388,6 +2534,8 @@ static const CRPCCommand commands[] =
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
+    { "blockchain",         "loadtxoutset",           &loadtxoutset,           {"path", "hash"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
     { "blockchain",         "getspentinfo",           &getspentinfo,           {"txid","index"}  },
 
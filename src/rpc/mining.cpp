@@ -268,6 +268,7 @@ static UniValue prioritisetransaction(const JSONRPCRequest& request)
     }
 
     mempool.PrioritiseTransaction(hash, nAmount);
+    if (g_block_candidate) g_block_candidate->Invalidate();
     return true;
 }
 
@@ -999,6 +999,80 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     return tx->GetHash().GetHex();
 }
 
+static UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    RPCHelpMan{"sendrawtransactions",
+                "\nSubmit several raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThis has the same effect as calling sendrawtransaction for each, but validates them all at once,\n"
+                "which is much faster for large batches. Transactions may spend outputs of others in the batch,\n"
+                "in any order. A transaction that is rejected does not stop the others from being submitted.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions.",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"maxfeerate", RPCArg::Type::AMOUNT, /* default */ FormatMoney(DEFAULT_MAX_RAW_TX_FEE_RATE.GetFeePerK()),
+                        "Reject transactions whose fee rate is higher than the specified value, expressed in " + CURRENCY_UNIT +
+                            "/kB.\nSet to 0 to accept any fee rate.\n"},
+                },
+                RPCResult{
+            "[                   (array) The result for each raw transaction in the input array, in the same order.\n"
+            " {\n"
+            "  \"txid\"           (string) The transaction hash in hex\n"
+            "  \"error\"          (string) Why the transaction was not submitted (only present on failure)\n"
+            " }\n"
+            "]\n"
+                },
+                RPCExamples{
+            HelpExampleCli("sendrawtransactions", "\"[\\\"signedhex1\\\", \\\"signedhex2\\\"]\"") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedhex1\", \"signedhex2\"]")
+                },
+    }.Check(request);
+
+    RPCTypeCheck(request.params, {
+        UniValue::VARR,
+        UniValueType(), // NUM, checked later
+    });
+
+    CFeeRate max_raw_tx_fee_rate = DEFAULT_MAX_RAW_TX_FEE_RATE;
+    if (!request.params[1].isNull()) {
+        max_raw_tx_fee_rate = CFeeRate(AmountFromValue(request.params[1]));
+    }
+
+    // Decode everything before submitting anything
+    const UniValue& rawtxs = request.params[0].get_array();
+    std::vector<CTransactionRef> txs;
+    std::vector<CAmount> max_raw_tx_fees;
+    txs.reserve(rawtxs.size());
+    max_raw_tx_fees.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); i++) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+        max_raw_tx_fees.push_back(max_raw_tx_fee_rate.GetFee(GetVirtualTransactionSize(*txs.back())));
+    }
+
+    std::vector<std::string> err_strings;
+    AssertLockNotHeld(cs_main);
+    const std::vector<TransactionError> errors = BroadcastTransactions(txs, err_strings, max_raw_tx_fees, /*relay*/ true, /*wait_callback*/ true);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); i++) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", txs[i]->GetHash().GetHex());
+        if (errors[i] != TransactionError::OK) {
+            entry.pushKV("error", err_strings[i].empty() ? TransactionErrorString(errors[i]) : err_strings[i]);
+        }
+        result.push_back(std::move(entry));
+    }
+    return result;
+}
+
 static UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     RPCHelpMan{"testmempoolaccept",
@@ -1921,6 +1995,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees|maxfeerate"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","maxfeerate"} },
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
     { "rawtransactions",    "testmempoolaccept",            &testmempoolaccept,         {"rawtxs","allowhighfees|maxfeerate"} },
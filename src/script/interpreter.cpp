@@ -936,7 +936,9 @@ bool EvalScript(std::vector<std::vector<unsigned char> >& stack, const CScript&
                         //serror is set
                         return false;
                     }
-                    bool fSuccess = checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
+                    // A failed signature fails the script if it has to be valid or be empty
+                    const bool fDeferrable = opcode == OP_CHECKSIGVERIFY || ((flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size());
+                    bool fSuccess = fDeferrable ? checker.CheckSigDeferrable(vchSig, vchPubKey, scriptCode, sigversion) : checker.CheckSig(vchSig, vchPubKey, scriptCode, sigversion);
 
                     if (!fSuccess && (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size())
                         return set_error(serror, SCRIPT_ERR_SIG_NULLFAIL);
@@ -1309,6 +1311,18 @@ bool GenericTransactionSignatureChecker<T>::VerifySignature(const std::vector<un
 
 template <class T>
 bool GenericTransactionSignatureChecker<T>::CheckSig(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
+{
+    return CheckSig(vchSigIn, vchPubKey, scriptCode, sigversion, /* deferrable */ false);
+}
+
+template <class T>
+bool GenericTransactionSignatureChecker<T>::CheckSigDeferrable(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const
+{
+    return CheckSig(vchSigIn, vchPubKey, scriptCode, sigversion, /* deferrable */ true);
+}
+
+template <class T>
+bool GenericTransactionSignatureChecker<T>::CheckSig(const std::vector<unsigned char>& vchSigIn, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion, bool deferrable) const
 {
     CPubKey pubkey(vchPubKey);
     if (!pubkey.IsValid())
@@ -1323,7 +1337,7 @@ bool GenericTransactionSignatureChecker<T>::CheckSig(const std::vector<unsigned
 
     uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, nHashType, amount, sigversion, this->txdata);
 
-    if (!VerifySignature(vchSig, pubkey, sighash))
+    if (!(deferrable ? DeferSignature(vchSig, pubkey, sighash) : VerifySignature(vchSig, pubkey, sighash)))
         return false;
 
     return true;
@@ -11,8 +11,28 @@
 #include <uint256.h>
 #include <util/system.h>
 
-#include <cuckoocache.h>
-#include <boost/thread.hpp>
+size_t ShardedCuckooCache::setup_bytes(size_t bytes)
+{
+    size_t elements = 0;
+    for (Shard& shard : m_shards) {
+        elements += shard.set.setup_bytes(bytes / SHARDS);
+    }
+    return elements;
+}
+
+bool ShardedCuckooCache::contains(const uint256& entry, bool erase)
+{
+    Shard& shard = GetShard(entry);
+    boost::shared_lock<boost::shared_mutex> lock(shard.mutex);
+    return shard.set.contains(entry, erase);
+}
+
+void ShardedCuckooCache::insert(const uint256& entry)
+{
+    Shard& shard = GetShard(entry);
+    boost::unique_lock<boost::shared_mutex> lock(shard.mutex);
+    shard.set.insert(entry);
+}
 
 namespace {
 /**
@@ -25,9 +45,7 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+    ShardedCuckooCache setValid;
 
 public:
     CSignatureCache()
@@ -44,16 +62,14 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
         return setValid.contains(entry, erase);
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
         setValid.insert(entry);
     }
-    uint32_t setup_bytes(size_t n)
+    size_t setup_bytes(size_t n)
     {
         return setValid.setup_bytes(n);
     }
@@ -92,3 +108,27 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+bool CachingTransactionSignatureChecker::DeferSignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    if (!deferred) return VerifySignature(vchSig, pubkey, sighash);
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    if (signatureCache.Get(entry, !store))
+        return true;
+    deferred->push_back(DeferredSignature{vchSig, pubkey, sighash, entry});
+    return true;
+}
+
+bool VerifyDeferredSignatures(const std::vector<DeferredSignature>& sigs, bool store)
+{
+    for (const DeferredSignature& sig : sigs) {
+        if (!sig.pubkey.Verify(sig.sighash, sig.sig))
+            return false;
+        if (store) {
+            uint256 entry = sig.entry;
+            signatureCache.Set(entry);
+        }
+    }
+    return true;
+}
@@ -7,10 +7,15 @@
 #ifndef AURORACOIN_SCRIPT_SIGCACHE_H
 #define AURORACOIN_SCRIPT_SIGCACHE_H
 
+#include <cuckoocache.h>
+#include <pubkey.h>
 #include <script/interpreter.h>
 
+#include <array>
 #include <vector>
 
+#include <boost/thread/shared_mutex.hpp>
+
 // DoS prevention: limit cache size to 32MB (over 1000000 entries on 64-bit
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
@@ -18,8 +23,6 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
-class CPubKey;
-
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
  * blinding in the set hash computation.
@@ -41,17 +44,64 @@ public:
     }
 };
 
+/**
+ * A cuckoo cache of nonced hashes split into shards that each have their own
+ * lock, so that script check threads looking up and adding entries at the same
+ * time mostly take different locks instead of all sharing one. An entry's
+ * shard is picked by its first byte, which only slightly affects where the
+ * shard stores it.
+ */
+class ShardedCuckooCache
+{
+public:
+    static const size_t SHARDS = 32;
+
+    /** Split bytes between the shards, returning the number of entries they can hold together */
+    size_t setup_bytes(size_t bytes);
+
+    bool contains(const uint256& entry, bool erase);
+    void insert(const uint256& entry);
+
+private:
+    struct alignas(64) Shard {
+        CuckooCache::cache<uint256, SignatureCacheHasher> set;
+        boost::shared_mutex mutex;
+    };
+    std::array<Shard, SHARDS> m_shards;
+
+    Shard& GetShard(const uint256& entry) { return m_shards[*entry.begin() % SHARDS]; }
+};
+
+/** A signature passed to CheckSigDeferrable, to be verified after the script ran. */
+struct DeferredSignature {
+    std::vector<unsigned char> sig;
+    CPubKey pubkey;
+    uint256 sighash;
+    //! signature cache entry, added once the signature is verified
+    uint256 entry;
+};
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    std::vector<DeferredSignature>* deferred;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
+    /** With deferredIn, signatures from CheckSigDeferrable that are not cached are appended to it instead of verified. */
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, std::vector<DeferredSignature>* deferredIn = nullptr) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), deferred(deferredIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
+    bool DeferSignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
+/**
+ * Verify signatures deferred by CachingTransactionSignatureChecker, adding
+ * them to the signature cache if store is set. Returns false if any of them
+ * is invalid, without telling which one.
+ */
+bool VerifyDeferredSignatures(const std::vector<DeferredSignature>& sigs, bool store);
+
 void InitSignatureCache();
 
 #endif // AURORACOIN_SCRIPT_SIGCACHE_H
@@ -297,6 +297,7 @@ public:
     bool empty() const                               { return vch.size() == nReadPos; }
     void resize(size_type n, value_type c=0)         { vch.resize(n + nReadPos, c); }
     void reserve(size_type n)                        { vch.reserve(n + nReadPos); }
+    size_type capacity() const                       { return vch.capacity() - nReadPos; }
     const_reference operator[](size_type pos) const  { return vch[pos + nReadPos]; }
     reference operator[](size_type pos)              { return vch[pos + nReadPos]; }
     void clear()                                     { vch.clear(); nReadPos = 0; }
@@ -470,6 +471,15 @@ public:
         clear();
     }
 
+    /**
+     * Exchange the underlying buffer with d, including any bytes that were
+     * already read. The read position is reset to the start of the new buffer.
+     */
+    void swap(CSerializeData &d) {
+        vch.swap(d);
+        nReadPos = 0;
+    }
+
     /**
      * XOR the contents of this stream with a certain key.
      *
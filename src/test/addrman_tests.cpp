@@ -410,6 +410,42 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr)
     BOOST_CHECK_EQUAL(addrman.size(), 2006U);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_getaddr_snapshot)
+{
+    CAddrManTest addrman;
+    const int64_t nNow = GetTime();
+
+    for (unsigned int i = 1; i < 256; i++) {
+        std::string strAddr = std::to_string(i) + ".2.1.23";
+        CAddress addr = CAddress(ResolveService(strAddr), NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        addrman.Add(addr, ResolveIP(strAddr));
+    }
+    std::vector<CAddress> vAddr1 = addrman.GetAddrSnapshot(nNow);
+    BOOST_CHECK_EQUAL(vAddr1.size(), (addrman.size() * 23) / 100);
+
+    // Test: The same selection is returned within the snapshot interval,
+    //  even after the table changed.
+    for (unsigned int i = 1; i < 256; i++) {
+        std::string strAddr = std::to_string(i) + ".3.1.23";
+        CAddress addr = CAddress(ResolveService(strAddr), NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        addrman.Add(addr, ResolveIP(strAddr));
+    }
+    std::vector<CAddress> vAddr2 = addrman.GetAddrSnapshot(nNow + ADDRMAN_GETADDR_SNAPSHOT_INTERVAL - 1);
+    BOOST_CHECK(vAddr1 == vAddr2);
+
+    // Test: A new selection is made once the interval is over.
+    std::vector<CAddress> vAddr3 = addrman.GetAddrSnapshot(nNow + ADDRMAN_GETADDR_SNAPSHOT_INTERVAL);
+    BOOST_CHECK_EQUAL(vAddr3.size(), (addrman.size() * 23) / 100);
+    BOOST_CHECK(vAddr3.size() > vAddr1.size());
+
+    // Test: Clearing addrman drops the snapshot.
+    addrman.Clear();
+    BOOST_CHECK_EQUAL(addrman.size(), 0U);
+    BOOST_CHECK_EQUAL(addrman.GetAddrSnapshot(nNow + ADDRMAN_GETADDR_SNAPSHOT_INTERVAL).size(), 0U);
+}
+
 
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket)
 {
@@ -0,0 +1,309 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <node/blockdownload.h>
+#include <test/setup_common.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+static uint256 BlockHash(int height)
+{
+    return ArithToUint256(arith_uint256(height + 1));
+}
+
+BOOST_AUTO_TEST_CASE(peer_window)
+{
+    BlockDownloadScheduler scheduler;
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(0), INITIAL_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(scheduler.GetDownloadWindow(), BLOCK_DOWNLOAD_WINDOW);
+
+    // A fast peer gets the full window, a slow one just enough for BLOCK_DOWNLOAD_QUEUE_TIME
+    scheduler.BlockReceived(0, BlockHash(1), seconds{10}, seconds{10} + milliseconds{10});
+    scheduler.BlockReceived(1, BlockHash(2), seconds{10}, seconds{12});
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(1), 2U);
+    BOOST_CHECK(scheduler.GetPeerBlockTime(1) == seconds{2});
+    BOOST_CHECK_EQUAL(scheduler.GetValidationBacklog(), 2U);
+
+    // Back-to-back blocks are timed from the previous arrival, not the request
+    scheduler.BlockReceived(1, BlockHash(3), seconds{10}, seconds{14});
+    BOOST_CHECK(scheduler.GetPeerBlockTime(1) == seconds{2});
+
+    scheduler.ForgetPeer(1);
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(1), INITIAL_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(validation_backlog)
+{
+    BlockDownloadScheduler scheduler;
+    // Blocks validating at 200ms each: the lookahead is BLOCK_DOWNLOAD_WINDOW_TIME worth of them
+    microseconds now = seconds{100};
+    scheduler.BlockReceived(0, BlockHash(0), now, now + milliseconds{1});
+    now += milliseconds{1};
+    for (int height = 1; height < 20; height++) {
+        scheduler.BlockReceived(0, BlockHash(height), now, now + milliseconds{1});
+        now += milliseconds{200};
+        scheduler.BlockConnected(BlockHash(height - 1), now);
+    }
+    BOOST_CHECK_EQUAL(scheduler.GetValidationBacklog(), 1U);
+    BOOST_CHECK_EQUAL(scheduler.GetDownloadWindow(), BLOCK_DOWNLOAD_WINDOW_TIME / milliseconds{200});
+
+    // As unconnected blocks fill the lookahead, the windows shrink to a single block
+    const unsigned int target = scheduler.GetDownloadWindow();
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(0), MAX_BLOCKS_IN_TRANSIT_PER_PEER * (target - 1) / target);
+    for (unsigned int height = 100; height < 100 + target / 2; height++) {
+        scheduler.BlockReceived(0, BlockHash(height), now, now + milliseconds{1});
+    }
+    BOOST_CHECK_LT(scheduler.GetPeerWindow(0), (unsigned int)MAX_BLOCKS_IN_TRANSIT_PER_PEER / 2);
+    for (unsigned int height = 100 + target / 2; height < 100 + target; height++) {
+        scheduler.BlockReceived(0, BlockHash(height), now, now + milliseconds{1});
+    }
+    BOOST_CHECK_EQUAL(scheduler.GetPeerWindow(0), 1U);
+
+    // Invalid blocks leave the backlog, and so do ones that never connect
+    scheduler.ForgetBlock(BlockHash(100));
+    BOOST_CHECK_EQUAL(scheduler.GetValidationBacklog(), target);
+    scheduler.BlockReceived(0, BlockHash(1000), now + UNVALIDATED_BLOCK_EXPIRY, now + UNVALIDATED_BLOCK_EXPIRY + seconds{1});
+    BOOST_CHECK_EQUAL(scheduler.GetValidationBacklog(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(rerequest)
+{
+    BlockDownloadScheduler scheduler;
+    const microseconds now = seconds{100};
+    // Nothing is known about the candidate
+    BOOST_CHECK(!scheduler.ShouldRerequest(0, now - seconds{10}, 0, 1, 0, now));
+
+    scheduler.BlockReceived(1, BlockHash(1), now - seconds{20}, now - seconds{20} + milliseconds{50});
+    // The holder has sent nothing: wait BLOCK_REREQUEST_MIN_DELAY
+    BOOST_CHECK(!scheduler.ShouldRerequest(0, now - milliseconds{500}, 0, 1, 0, now));
+    BOOST_CHECK(scheduler.ShouldRerequest(0, now - seconds{2}, 0, 1, 0, now));
+
+    // A holder taking 500ms per block may be up to BLOCK_REREQUEST_FACTOR block times late
+    scheduler.BlockReceived(0, BlockHash(2), now - seconds{10}, now - seconds{10} + milliseconds{500});
+    BOOST_CHECK(!scheduler.ShouldRerequest(0, now - milliseconds{1400}, 0, 1, 0, now));
+    BOOST_CHECK(scheduler.ShouldRerequest(0, now - milliseconds{1600}, 0, 1, 0, now));
+    // ...unless the block is far down its queue and the candidate has room
+    BOOST_CHECK(!scheduler.ShouldRerequest(0, now - milliseconds{500}, 7, 1, 0, now));
+    BOOST_CHECK(scheduler.ShouldRerequest(0, now - milliseconds{1500}, 7, 1, 0, now));
+    BOOST_CHECK(!scheduler.ShouldRerequest(0, now - milliseconds{1500}, 7, 1, 20, now));
+    // Never to a slower peer
+    BOOST_CHECK(!scheduler.ShouldRerequest(1, now - seconds{10}, 0, 0, 0, now));
+}
+
+/**
+ * Download a chain from peers of very different speeds into a node that
+ * validates one block at a time, the way net_processing schedules it: every
+ * 10ms each peer with room in its window is assigned the lowest missing
+ * blocks, and a peer holding up a full download window for
+ * BLOCK_STALLING_TIMEOUT is disconnected.
+ */
+class DownloadSimulation
+{
+public:
+    struct Result {
+        microseconds duration{0};
+        size_t max_backlog{0};
+        int rerequests{0};
+        int disconnects{0};
+    };
+
+    DownloadSimulation(std::vector<microseconds> block_times, microseconds validation_time, bool adaptive)
+        : m_validation_time(validation_time), m_adaptive(adaptive)
+    {
+        for (const microseconds& block_time : block_times) {
+            m_peers.emplace_back(block_time);
+        }
+    }
+
+    Result Run(int blocks)
+    {
+        m_received.assign(blocks, microseconds{-1});
+        m_holder.assign(blocks, -1);
+        Result result;
+        const microseconds tick = milliseconds{10};
+        microseconds now{0};
+        while (m_tip + 1 < blocks) {
+            now += tick;
+            Deliver(now);
+            Validate(now);
+            for (size_t peer = 0; peer < m_peers.size(); peer++) {
+                if (m_peers[peer].connected) Schedule(peer, now, blocks, result);
+            }
+            size_t backlog = 0;
+            for (int height = m_tip + 1; height < blocks; height++) backlog += m_received[height].count() >= 0;
+            result.max_backlog = std::max(result.max_backlog, backlog);
+            BOOST_REQUIRE(now < std::chrono::hours{1});
+        }
+        result.duration = now;
+        return result;
+    }
+
+private:
+    struct SimPeer {
+        explicit SimPeer(microseconds block_time_in) : block_time(block_time_in) {}
+        microseconds block_time;
+        bool connected{true};
+        std::deque<std::pair<int, microseconds>> queue; //!< requested heights and when
+        microseconds last_sent{0};
+        microseconds stalling_since{0};
+    };
+
+    const microseconds m_validation_time;
+    const bool m_adaptive;
+    std::vector<SimPeer> m_peers;
+    std::vector<microseconds> m_received;
+    std::vector<int> m_holder;
+    BlockDownloadScheduler m_scheduler;
+    int m_tip{-1};
+    microseconds m_validation_done{0};
+
+    void Deliver(microseconds now)
+    {
+        for (size_t peer = 0; peer < m_peers.size(); peer++) {
+            SimPeer& p = m_peers[peer];
+            while (!p.queue.empty()) {
+                const int height = p.queue.front().first;
+                const microseconds requested = p.queue.front().second;
+                const microseconds arrival = std::max(requested, p.last_sent) + p.block_time;
+                if (arrival > now) break;
+                p.queue.pop_front();
+                p.last_sent = arrival;
+                // Blocks taken over by another peer arrive unrequested and are ignored
+                if (m_holder[height] != (int)peer) continue;
+                m_holder[height] = -1;
+                p.stalling_since = microseconds{0};
+                if (m_received[height].count() >= 0) continue;
+                m_received[height] = arrival;
+                if (m_adaptive) m_scheduler.BlockReceived(peer, BlockHash(height), requested, arrival);
+            }
+        }
+    }
+
+    void Validate(microseconds now)
+    {
+        while (m_tip + 1 < (int)m_received.size() && m_received[m_tip + 1].count() >= 0) {
+            const microseconds done = std::max(m_validation_done, m_received[m_tip + 1]) + m_validation_time;
+            if (done > now) break;
+            m_validation_done = done;
+            m_tip++;
+            if (m_adaptive) m_scheduler.BlockConnected(BlockHash(m_tip), done);
+        }
+    }
+
+    void Disconnect(size_t peer)
+    {
+        m_peers[peer].connected = false;
+        for (const auto& request : m_peers[peer].queue) {
+            if (m_holder[request.first] == (int)peer) m_holder[request.first] = -1;
+        }
+        m_peers[peer].queue.clear();
+        if (m_adaptive) m_scheduler.ForgetPeer(peer);
+    }
+
+    size_t InFlight(size_t peer) const
+    {
+        size_t count = 0;
+        for (const auto& request : m_peers[peer].queue) count += m_holder[request.first] == (int)peer;
+        return count;
+    }
+
+    /** Mirrors the getdata (blocks) step of SendMessages and FindNextBlocksToDownload. */
+    void Schedule(size_t peer, microseconds now, int blocks, Result& result)
+    {
+        const size_t window = m_adaptive ? m_scheduler.GetPeerWindow(peer) : MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+        const int lookahead = m_adaptive ? m_scheduler.GetDownloadWindow() : BLOCK_DOWNLOAD_WINDOW;
+        SimPeer& p = m_peers[peer];
+        if (p.stalling_since.count() > 0 && p.stalling_since < now - seconds{BLOCK_STALLING_TIMEOUT}) {
+            result.disconnects++;
+            Disconnect(peer);
+            return;
+        }
+        size_t in_flight = InFlight(peer);
+        if (in_flight >= window) return;
+
+        int waiting_for = -1;
+        int requested = 0;
+        const int window_end = m_tip + lookahead;
+        for (int height = m_tip + 1; height < blocks && in_flight < window; height++) {
+            if (m_received[height].count() >= 0) continue;
+            if (m_holder[height] == -1) {
+                if (height > window_end) {
+                    if (in_flight == 0 && waiting_for != -1 && waiting_for != (int)peer && m_peers[waiting_for].stalling_since.count() == 0) {
+                        m_peers[waiting_for].stalling_since = now;
+                    }
+                    return;
+                }
+                Request(peer, height, now);
+                in_flight++;
+                requested++;
+            } else if (waiting_for == -1) {
+                waiting_for = m_holder[height];
+                if (m_adaptive && waiting_for != (int)peer) {
+                    microseconds time_requested{0};
+                    int blocks_ahead = 0;
+                    for (const auto& request : m_peers[waiting_for].queue) {
+                        if (request.first == height) {
+                            time_requested = request.second;
+                            break;
+                        }
+                        blocks_ahead += m_holder[request.first] == waiting_for;
+                    }
+                    if (m_scheduler.ShouldRerequest(waiting_for, time_requested, blocks_ahead, peer, in_flight, now)) {
+                        m_peers[waiting_for].stalling_since = microseconds{0};
+                        Request(peer, height, now);
+                        in_flight++;
+                        requested++;
+                        result.rerequests++;
+                    }
+                }
+            }
+        }
+    }
+
+    void Request(size_t peer, int height, microseconds now)
+    {
+        m_holder[height] = peer;
+        m_peers[peer].queue.emplace_back(height, now);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(simulated_download)
+{
+    // Two fast peers, a mediocre one and two that can barely keep up, feeding
+    // a node that needs 40ms to validate a block.
+    const std::vector<microseconds> block_times{milliseconds{15}, milliseconds{25}, milliseconds{200}, milliseconds{1500}, milliseconds{4000}};
+    const microseconds validation_time = milliseconds{40};
+    const int blocks = 3000;
+
+    const DownloadSimulation::Result fixed = DownloadSimulation(block_times, validation_time, false).Run(blocks);
+    const DownloadSimulation::Result adaptive = DownloadSimulation(block_times, validation_time, true).Run(blocks);
+    BOOST_TEST_MESSAGE(strprintf("fixed windows: %.1fs, max backlog %u, %d disconnects",
+        fixed.duration.count() / 1e6, fixed.max_backlog, fixed.disconnects));
+    BOOST_TEST_MESSAGE(strprintf("adaptive windows: %.1fs, max backlog %u, %d re-requests, %d disconnects",
+        adaptive.duration.count() / 1e6, adaptive.max_backlog, adaptive.rerequests, adaptive.disconnects));
+
+    // Validation alone takes blocks * validation_time
+    BOOST_CHECK(adaptive.duration < validation_time * blocks * 11 / 10);
+    BOOST_CHECK(adaptive.duration <= fixed.duration);
+    BOOST_CHECK_LT(adaptive.max_backlog, fixed.max_backlog);
+    BOOST_CHECK_GT(adaptive.rerequests, 0);
+    // Slow peers are worked around rather than disconnected
+    BOOST_CHECK_LT(adaptive.disconnects, fixed.disconnects);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -7,9 +7,11 @@
 #include <attributes.h>
 #include <clientversion.h>
 #include <coins.h>
+#include <node/utxo_snapshot.h>
 #include <script/standard.h>
 #include <streams.h>
 #include <test/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -863,4 +865,72 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(utxo_snapshot_roundtrip)
+{
+    CCoinsViewDB db("", 1 << 20, true, false);
+    std::map<COutPoint, Coin> coins;
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 100; i++) {
+            const uint256 txid = InsecureRand256();
+            const uint32_t outputs = 1 + InsecureRandRange(3);
+            for (uint32_t n = 0; n < outputs; n++) {
+                Coin coin(CTxOut(InsecureRandRange(1000 * COIN), CScript() << OP_TRUE << n), 1 + i, n == 0);
+                coins.emplace(COutPoint(txid, n * 2), coin);
+                cache.AddCoin(COutPoint(txid, n * 2), std::move(coin), false);
+            }
+        }
+        cache.SetBestBlock(InsecureRand256());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    const fs::path path = GetDataDir() / "utxo.dat";
+    SnapshotMetadata metadata;
+    {
+        std::unique_ptr<CCoinsViewCursor> cursor(db.Cursor());
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_CHECK(WriteUTXOSnapshot(*cursor, file, metadata));
+    }
+    BOOST_CHECK(metadata.m_base_blockhash == db.GetBestBlock());
+    BOOST_CHECK_EQUAL(metadata.m_coins_count, coins.size());
+
+    // Coins come back in outpoint order with the header as written
+    std::string error;
+    SnapshotMetadata read_metadata;
+    std::map<COutPoint, Coin> read_coins;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> read_metadata;
+        BOOST_CHECK(read_metadata.m_utxo_hash == metadata.m_utxo_hash);
+        BOOST_CHECK(ReadUTXOSnapshot(file, read_metadata, [&](const COutPoint& outpoint, Coin&& coin) {
+            BOOST_CHECK(read_coins.empty() || read_coins.rbegin()->first < outpoint);
+            read_coins.emplace(outpoint, std::move(coin));
+        }, error));
+    }
+    BOOST_CHECK_EQUAL(read_coins.size(), coins.size());
+    for (const auto& entry : coins) {
+        BOOST_CHECK(read_coins.count(entry.first) && read_coins.at(entry.first) == entry.second);
+    }
+
+    // A header that does not commit to the coins is rejected
+    read_metadata.m_utxo_hash = InsecureRand256();
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata ignored;
+        file >> ignored;
+        BOOST_CHECK(!ReadUTXOSnapshot(file, read_metadata, nullptr, error));
+        BOOST_CHECK(error.find("hash mismatch") != std::string::npos);
+    }
+
+    // So is a truncated file
+    read_metadata.m_utxo_hash = metadata.m_utxo_hash;
+    read_metadata.m_coins_count++;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        SnapshotMetadata ignored;
+        file >> ignored;
+        BOOST_CHECK(!ReadUTXOSnapshot(file, read_metadata, nullptr, error));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
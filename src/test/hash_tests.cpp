@@ -147,6 +147,18 @@ BOOST_AUTO_TEST_CASE(siphash)
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and SipHashUint256x4.
+    for (int i = 0; i < 16; ++i) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        uint256 x[4] = {InsecureRand256(), InsecureRand256(), InsecureRand256(), InsecureRand256()};
+        uint64_t out[4];
+        SipHashUint256x4(k1, k2, x[0], x[1], x[2], x[3], out);
+        for (int j = 0; j < 4; ++j) {
+            BOOST_CHECK_EQUAL(out[j], SipHashUint256(k1, k2, x[j]));
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
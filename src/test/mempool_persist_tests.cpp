@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <fs.h>
+#include <test/setup_common.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempool_persist_tests, TestingSetup)
+
+static CTransactionRef MakeTx(const uint256& prev_hash)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(COutPoint(prev_hash, 0));
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.emplace_back(COIN, CScript() << OP_1);
+    return MakeTransactionRef(tx);
+}
+
+static std::set<uint256> ReadTxids(std::map<uint256, CAmount>& mapDeltas)
+{
+    std::vector<std::pair<CTransactionRef, int64_t>> txs;
+    BOOST_CHECK(ReadMempool(txs, mapDeltas));
+    std::set<uint256> txids;
+    for (const auto& entry : txs) {
+        txids.insert(entry.first->GetHash());
+    }
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(incremental_dumps)
+{
+    const fs::path path = GetDataDir() / "mempool.dat";
+    TestMemPoolEntryHelper entry;
+    LOCK2(cs_main, mempool.cs);
+    const CTransactionRef a = MakeTx(InsecureRand256());
+    const CTransactionRef b = MakeTx(a->GetHash());
+    const CTransactionRef c = MakeTx(InsecureRand256());
+    mempool.addUnchecked(entry.Time(1).FromTx(a));
+    mempool.addUnchecked(entry.Time(2).FromTx(b));
+    BOOST_CHECK(DumpMempool(mempool));
+    const uint64_t full_size = fs::file_size(path);
+
+    std::map<uint256, CAmount> mapDeltas;
+    BOOST_CHECK(ReadTxids(mapDeltas) == std::set<uint256>({a->GetHash(), b->GetHash()}));
+
+    // Only the changes are appended
+    mempool.removeRecursive(*b, MemPoolRemovalReason::REPLACED);
+    mempool.addUnchecked(entry.Time(3).FromTx(c));
+    mempool.PrioritiseTransaction(c->GetHash(), 100);
+    BOOST_CHECK(DumpMempool(mempool, /* full */ false));
+    const uint64_t appended_size = fs::file_size(path);
+    BOOST_CHECK(appended_size > full_size);
+    BOOST_CHECK(appended_size - full_size < full_size);
+    BOOST_CHECK(ReadTxids(mapDeltas) == std::set<uint256>({a->GetHash(), c->GetHash()}));
+    BOOST_CHECK_EQUAL(mapDeltas.size(), 1U);
+    BOOST_CHECK_EQUAL(mapDeltas[c->GetHash()], 100);
+
+    // An incomplete last segment is ignored, and the next dump writes the file anew
+    fs::resize_file(path, appended_size - 1);
+    BOOST_CHECK(ReadTxids(mapDeltas) == std::set<uint256>({a->GetHash(), b->GetHash()}));
+    BOOST_CHECK(DumpMempool(mempool, /* full */ false));
+    BOOST_CHECK(ReadTxids(mapDeltas) == std::set<uint256>({a->GetHash(), c->GetHash()}));
+    BOOST_CHECK(fs::file_size(path) < appended_size);
+
+    // So does a dump after the file was removed
+    fs::remove(path);
+    BOOST_CHECK(DumpMempool(mempool, /* full */ false));
+    BOOST_CHECK(ReadTxids(mapDeltas) == std::set<uint256>({a->GetHash(), c->GetHash()}));
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -529,20 +529,21 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    // we only require this to remove, at max, 2 txn, because it's not clear what we're really optimizing for aside from that
+    // tx7 pays for tx5 and tx6, so the three of them are the lowest feerate chunk
     pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
     BOOST_CHECK(pool.exists(tx4.GetHash()));
-    BOOST_CHECK(pool.exists(tx6.GetHash()));
+    BOOST_CHECK(!pool.exists(tx5.GetHash()));
+    BOOST_CHECK(!pool.exists(tx6.GetHash()));
     BOOST_CHECK(!pool.exists(tx7.GetHash()));
 
-    if (!pool.exists(tx5.GetHash()))
-        pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // the chunk goes as a whole, leaving tx4
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
-    BOOST_CHECK(pool.exists(tx6.GetHash()));
+    BOOST_CHECK(!pool.exists(tx6.GetHash()));
     BOOST_CHECK(!pool.exists(tx7.GetHash()));
 
     pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
@@ -753,4 +754,65 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClusterTests)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [a].0 <- [b]     [c]
+    //   \---1 <- [d]
+    CTransactionRef a = make_tx(/* output_values */ {5 * COIN, 5 * COIN});
+    CTransactionRef b = make_tx(/* output_values */ {5 * COIN}, /* inputs */ {a});
+    CTransactionRef c = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef d = make_tx(/* output_values */ {4 * COIN}, /* inputs */ {a}, /* input_indices */ {1});
+    pool.addUnchecked(entry.Fee(100LL).FromTx(a));
+    pool.addUnchecked(entry.Fee(20000LL).FromTx(b));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(c));
+    pool.addUnchecked(entry.Fee(10LL).FromTx(d));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+
+    // b pays for a, so they are a chunk; d comes after them
+    const CTxMemPool::Cluster* cluster = &pool.GetCluster(*pool.GetIter(d->GetHash()));
+    BOOST_CHECK(cluster == &pool.GetCluster(*pool.GetIter(a->GetHash())));
+    BOOST_CHECK_EQUAL(cluster->linearization.size(), 3U);
+    BOOST_CHECK(cluster->linearization[0]->GetTx().GetHash() == a->GetHash());
+    BOOST_CHECK(cluster->linearization[1]->GetTx().GetHash() == b->GetHash());
+    BOOST_CHECK(cluster->linearization[2]->GetTx().GetHash() == d->GetHash());
+    BOOST_CHECK_EQUAL(cluster->chunks.size(), 2U);
+    BOOST_CHECK_EQUAL(cluster->chunks[0].fee, 20100);
+    BOOST_CHECK_EQUAL(cluster->chunks[0].end, 2U);
+
+    // With a higher fee, d goes first with a
+    pool.PrioritiseTransaction(d->GetHash(), 100000);
+    cluster = &pool.GetCluster(*pool.GetIter(d->GetHash()));
+    BOOST_CHECK(cluster->linearization[1]->GetTx().GetHash() == d->GetHash());
+    BOOST_CHECK_EQUAL(cluster->chunks.size(), 2U);
+    BOOST_CHECK_EQUAL(cluster->chunks[0].fee, 100110);
+    pool.PrioritiseTransaction(d->GetHash(), -100000);
+
+    // The lowest feerate chunk is evicted first, even though it has ancestors
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(pool.exists(a->GetHash()));
+    BOOST_CHECK(pool.exists(b->GetHash()));
+    BOOST_CHECK(pool.exists(c->GetHash()));
+    BOOST_CHECK(!pool.exists(d->GetHash()));
+
+    // Mining a splits its cluster in two
+    pool.addUnchecked(entry.Fee(10LL).FromTx(d));
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 2U);
+    pool.removeForBlock({a}, 1);
+    BOOST_CHECK_EQUAL(pool.GetClusters().size(), 3U);
+    BOOST_CHECK_EQUAL(pool.GetCluster(*pool.GetIter(b->GetHash())).linearization.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetCluster(*pool.GetIter(d->GetHash())).linearization.size(), 1U);
+
+    // A transaction spending b and c would merge their clusters
+    CTxMemPool::setEntries ancestors{*pool.GetIter(b->GetHash()), *pool.GetIter(c->GetHash())};
+    const int64_t size_b_c = pool.GetIter(b->GetHash()).get()->GetTxSize() + pool.GetIter(c->GetHash()).get()->GetTxSize();
+    std::string err;
+    BOOST_CHECK(pool.CheckClusterLimits(ancestors, 100, 3, size_b_c + 100, err));
+    BOOST_CHECK(!pool.CheckClusterLimits(ancestors, 100, 2, size_b_c + 100, err));
+    BOOST_CHECK(!pool.CheckClusterLimits(ancestors, 100, 3, size_b_c + 99, err));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -304,5 +304,78 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(recv_buffer_pool)
+{
+    CRecvBufferPool pool;
+
+    CSerializeData buf = pool.Acquire(100);
+    BOOST_CHECK(buf.empty());
+    BOOST_CHECK_EQUAL(buf.capacity(), 1024U);
+    buf.resize(100);
+    const char* const data = buf.data();
+    pool.Release(std::move(buf));
+    BOOST_CHECK_EQUAL(pool.GetStats().pooled_bytes, 1024U);
+
+    // The released buffer comes back for any request of its class.
+    CSerializeData reused = pool.Acquire(1000);
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK(reused.data() == data);
+    BOOST_CHECK_EQUAL(pool.GetStats().allocations, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().reuses, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats().pooled_bytes, 0U);
+
+    // A bigger request needs a bigger class.
+    CSerializeData bigger = pool.Acquire(1025);
+    BOOST_CHECK_EQUAL(bigger.capacity(), 16U * 1024);
+    BOOST_CHECK_EQUAL(pool.GetStats().allocations, 2U);
+
+    // Buffers larger than any message are not kept.
+    CSerializeData huge = pool.Acquire(MAX_PROTOCOL_MESSAGE_LENGTH + 1);
+    BOOST_CHECK_EQUAL(huge.capacity(), MAX_PROTOCOL_MESSAGE_LENGTH + 1);
+    pool.Release(std::move(huge));
+    BOOST_CHECK_EQUAL(pool.GetStats().pooled_bytes, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(receive_msg_bytes_in_place)
+{
+    CAddress addr(CService(CNetAddr(), 0), NODE_NONE);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", true);
+
+    const std::vector<unsigned char> payload = g_insecure_rand_ctx.randbytes(300000);
+    CMessageHeader hdr(Params().MessageStart(), NetMsgType::BLOCK, payload.size());
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<unsigned char> stream;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, stream, 0, hdr};
+    stream.insert(stream.end(), payload.begin(), payload.end());
+
+    // No message is in progress before the header arrives.
+    unsigned int nWindow = 0;
+    BOOST_CHECK(node.GetRecvWindow(0x10000, nWindow) == nullptr);
+
+    bool complete = false;
+    size_t pos = 1000;
+    BOOST_CHECK(node.ReceiveMsgBytes((const char*)stream.data(), pos, complete));
+    BOOST_CHECK(!complete);
+
+    // Read the rest of the payload into the message buffer, as the socket handler does.
+    while (char* pchWindow = node.GetRecvWindow(1, nWindow)) {
+        BOOST_CHECK(nWindow > 0);
+        const unsigned int nBytes = std::min<size_t>(nWindow, stream.size() - pos);
+        memcpy(pchWindow, stream.data() + pos, nBytes);
+        pos += nBytes;
+        BOOST_CHECK(node.ReceiveMsgBytes(pchWindow, nBytes, complete));
+    }
+    BOOST_CHECK_EQUAL(pos, stream.size());
+    BOOST_CHECK(complete);
+
+    node.MarkReceivedMsgsForProcessing(MAX_PROTOCOL_MESSAGE_LENGTH);
+    LOCK(node.cs_vProcessMsg);
+    BOOST_REQUIRE_EQUAL(node.vProcessMsg.size(), 1U);
+    const CNetMessage& msg = node.vProcessMsg.front();
+    BOOST_CHECK(msg.GetMessageHash() == hash);
+    BOOST_CHECK(std::equal(payload.begin(), payload.end(), msg.vRecv.begin(), [](unsigned char a, char b) { return a == (unsigned char)b; }));
+    BOOST_CHECK_EQUAL(node.nProcessQueueSize, stream.size());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
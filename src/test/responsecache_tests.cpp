@@ -0,0 +1,65 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/responsecache.h>
+#include <test/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(responsecache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cached_blocks)
+{
+    SerializedResponseCache cache(1, 2);
+    const uint256 hash = InsecureRand256();
+    BOOST_CHECK(!cache.GetBlock(hash, true));
+
+    // Each flavour is cached separately
+    cache.AddBlock(hash, true, {1, 2, 3});
+    BOOST_CHECK(!cache.GetBlock(hash, false));
+    cache.AddBlock(hash, false, {1, 2});
+    BOOST_CHECK(*cache.GetBlock(hash, true) == std::vector<unsigned char>({1, 2, 3}));
+    BOOST_CHECK(*cache.GetBlock(hash, false) == std::vector<unsigned char>({1, 2}));
+
+    // A payload being sent survives eviction
+    SerializedResponseCache::Payload in_use = cache.GetBlock(hash, true);
+    for (int i = 0; i < 4; i++) {
+        cache.AddBlock(InsecureRand256(), true, {4});
+    }
+    BOOST_CHECK(!cache.GetBlock(hash, true));
+    BOOST_CHECK(*in_use == std::vector<unsigned char>({1, 2, 3}));
+
+    cache.Clear();
+    BOOST_CHECK(!cache.GetBlock(hash, false));
+}
+
+BOOST_AUTO_TEST_CASE(cached_header_runs)
+{
+    SerializedResponseCache cache(2, 1);
+    const uint256 a = InsecureRand256(), b = InsecureRand256(), c = InsecureRand256();
+    SerializedResponseCache::HeadersRun run;
+    BOOST_CHECK(!cache.GetHeaders(a, uint256(), run));
+
+    cache.AddHeaders(a, uint256(), nullptr, 2000, {5});
+    cache.AddHeaders(b, uint256(), nullptr, 10, {6});
+    // The stop hash is part of the key
+    BOOST_CHECK(!cache.GetHeaders(a, b, run));
+    BOOST_CHECK(cache.GetHeaders(a, uint256(), run));
+    BOOST_CHECK_EQUAL(run.count, 2000);
+    BOOST_CHECK(*run.payload == std::vector<unsigned char>({5}));
+
+    // The least recently used run is evicted first
+    cache.AddHeaders(c, uint256(), nullptr, 1, {7});
+    BOOST_CHECK(!cache.GetHeaders(b, uint256(), run));
+    BOOST_CHECK(cache.GetHeaders(a, uint256(), run));
+    BOOST_CHECK(cache.GetHeaders(c, uint256(), run));
+
+    // Replacing a run keeps a single entry for it
+    cache.AddHeaders(c, uint256(), nullptr, 2, {8});
+    BOOST_CHECK(cache.GetHeaders(a, uint256(), run));
+    BOOST_CHECK(cache.GetHeaders(c, uint256(), run));
+    BOOST_CHECK_EQUAL(run.count, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
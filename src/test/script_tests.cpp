@@ -10,6 +10,7 @@
 #include <key.h>
 #include <script/script.h>
 #include <script/script_error.h>
+#include <script/sigcache.h>
 #include <script/sign.h>
 #include <script/signingprovider.h>
 #include <util/system.h>
@@ -17,6 +18,7 @@
 #include <test/setup_common.h>
 #include <rpc/util.h>
 #include <streams.h>
+#include <validation.h>
 
 #if defined(HAVE_CONSENSUS_LIB)
 #include <script/auroracoinconsensus.h>
@@ -1523,6 +1525,50 @@ BOOST_AUTO_TEST_CASE(script_can_append_self)
     BOOST_CHECK(s == d);
 }
 
+BOOST_AUTO_TEST_CASE(script_deferred_signatures)
+{
+    ScriptError err;
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    const CTransaction txFrom{BuildCreditingTransaction(scriptPubKey)};
+    CMutableTransaction txTo = BuildSpendingTransaction(CScript(), CScriptWitness(), txFrom);
+    const unsigned int flags = SCRIPT_VERIFY_NULLFAIL;
+
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(scriptPubKey, txTo, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    txTo.vin[0].scriptSig = CScript() << vchSig;
+    {
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        std::vector<DeferredSignature> deferred;
+        // Without NULLFAIL a bad signature may leave false on the stack for the script to use
+        BOOST_CHECK(VerifyScript(tx.vin[0].scriptSig, scriptPubKey, nullptr, 0, CachingTransactionSignatureChecker(&tx, 0, 0, false, txdata, &deferred), &err));
+        BOOST_CHECK(deferred.empty());
+        BOOST_CHECK(VerifyScript(tx.vin[0].scriptSig, scriptPubKey, nullptr, flags, CachingTransactionSignatureChecker(&tx, 0, 0, false, txdata, &deferred), &err));
+        BOOST_CHECK_EQUAL(deferred.size(), 1U);
+        BOOST_CHECK(VerifyDeferredSignatures(deferred, false));
+        BOOST_CHECK(CScriptCheck(txFrom.vout[0], tx, 0, flags, false, &txdata)());
+    }
+
+    // A bad signature passes the script, fails when verified, and CScriptCheck reports why
+    vchSig[10] ^= 1;
+    txTo.vin[0].scriptSig = CScript() << vchSig;
+    {
+        const CTransaction tx(txTo);
+        PrecomputedTransactionData txdata(tx);
+        std::vector<DeferredSignature> deferred;
+        BOOST_CHECK(VerifyScript(tx.vin[0].scriptSig, scriptPubKey, nullptr, flags, CachingTransactionSignatureChecker(&tx, 0, 0, false, txdata, &deferred), &err));
+        BOOST_CHECK_EQUAL(deferred.size(), 1U);
+        BOOST_CHECK(!VerifyDeferredSignatures(deferred, false));
+        CScriptCheck check(txFrom.vout[0], tx, 0, flags, false, &txdata);
+        BOOST_CHECK(!check());
+        BOOST_CHECK_EQUAL(check.GetScriptError(), SCRIPT_ERR_SIG_NULLFAIL);
+    }
+}
+
 
 #if defined(HAVE_CONSENSUS_LIB)
 
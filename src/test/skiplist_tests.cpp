@@ -45,6 +45,43 @@ BOOST_AUTO_TEST_CASE(skiplist_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+    std::vector<CBlockIndex*> vIndex;
+    const size_t length = 3 * CBlockIndexArena::CHUNK_SIZE + 7;
+
+    for (size_t i = 0; i < length; i++) {
+        CBlockIndex* pindex = arena.Allocate();
+        pindex->nHeight = i;
+        pindex->pprev = vIndex.empty() ? nullptr : vIndex.back();
+        pindex->BuildSkip();
+        vIndex.push_back(pindex);
+    }
+    BOOST_CHECK_EQUAL(arena.Size(), length);
+
+    // Entries never move while the arena grows
+    for (size_t i = 0; i < length; i++) {
+        BOOST_CHECK_EQUAL(vIndex[i]->nHeight, (int)i);
+        BOOST_CHECK(vIndex[length - 1]->GetAncestor(i) == vIndex[i]);
+    }
+
+    // A reservation is served from a single chunk
+    arena.Reserve(2 * CBlockIndexArena::CHUNK_SIZE);
+    CBlockIndex* first = arena.Allocate();
+    for (size_t i = 1; i < 2 * CBlockIndexArena::CHUNK_SIZE; i++) {
+        BOOST_CHECK(arena.Allocate() == first + i);
+    }
+
+    CBlockIndexArena other;
+    other.swap(arena);
+    BOOST_CHECK_EQUAL(arena.Size(), 0U);
+    BOOST_CHECK_EQUAL(other.Size(), length + 2 * CBlockIndexArena::CHUNK_SIZE);
+    BOOST_CHECK(vIndex[length - 1]->GetAncestor(0) == vIndex[0]);
+    other.Clear();
+    BOOST_CHECK_EQUAL(other.Size(), 0U);
+}
+
 BOOST_AUTO_TEST_CASE(getlocator_test)
 {
     // Build a main chain 100000 blocks long.
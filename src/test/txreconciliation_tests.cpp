@@ -0,0 +1,194 @@
+// Copyright (c) 2020 The Auroracoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/txreconciliation.h>
+#include <pinsketch.h>
+#include <random.h>
+#include <test/setup_common.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(pinsketch_decode)
+{
+    for (uint32_t capacity : {1, 2, 8, 20}) {
+        for (uint32_t diff = 0; diff <= capacity; diff++) {
+            PinSketch a(capacity), b(capacity);
+            std::vector<uint32_t> expected;
+            // Elements in both sets cancel out
+            for (int i = 0; i < 50; i++) {
+                const uint32_t shared = InsecureRand32() | 1;
+                a.Add(shared);
+                b.Add(shared);
+            }
+            for (uint32_t i = 0; i < diff; i++) {
+                const uint32_t element = InsecureRand32() | 1;
+                expected.push_back(element);
+                (i % 2 ? a : b).Add(element);
+            }
+
+            PinSketch received;
+            BOOST_CHECK(PinSketch::Deserialize(b.Serialize(), received));
+            BOOST_CHECK(received == b);
+            a.Merge(received);
+            std::vector<uint32_t> decoded;
+            BOOST_CHECK(a.Decode(decoded));
+            std::sort(expected.begin(), expected.end());
+            std::sort(decoded.begin(), decoded.end());
+            BOOST_CHECK(decoded == expected);
+        }
+    }
+
+    // A difference larger than the capacity is never decoded into as many elements
+    PinSketch overflow(8);
+    for (int i = 0; i < 9; i++) overflow.Add(InsecureRand32() | 1);
+    std::vector<uint32_t> decoded;
+    BOOST_CHECK(!overflow.Decode(decoded) || decoded.size() < 8);
+
+    PinSketch bad;
+    BOOST_CHECK(!PinSketch::Deserialize(std::vector<unsigned char>(7), bad));
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_register)
+{
+    TxReconciliationTracker tracker;
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1, 1) == TxReconciliationTracker::RegisterResult::NOT_FOUND);
+
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 0, 1) == TxReconciliationTracker::RegisterResult::PROTOCOL_VIOLATION);
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1, 1) == TxReconciliationTracker::RegisterResult::SUCCESS);
+    BOOST_CHECK(tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.RegisterPeer(0, true, 1, 1) == TxReconciliationTracker::RegisterResult::ALREADY_REGISTERED);
+
+    // The first outbound peers keep getting transactions by flooding
+    for (NodeId peer = 1; peer <= NodeId(MAX_OUTBOUND_FLOOD_TO); peer++) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.RegisterPeer(peer, false, 1, 1) == TxReconciliationTracker::RegisterResult::SUCCESS);
+        BOOST_CHECK(!tracker.AddToSet(peer, InsecureRand256()));
+    }
+    const NodeId outbound = MAX_OUTBOUND_FLOOD_TO + 1;
+    tracker.PreRegisterPeer(outbound);
+    BOOST_CHECK(tracker.RegisterPeer(outbound, false, 1, 1) == TxReconciliationTracker::RegisterResult::SUCCESS);
+    BOOST_CHECK(tracker.AddToSet(outbound, InsecureRand256()));
+    BOOST_CHECK(tracker.AddToSet(0, InsecureRand256()));
+
+    tracker.ForgetPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(!tracker.AddToSet(0, InsecureRand256()));
+}
+
+/**
+ * Connect an initiator to a responder: the initiator's flood-to slots are
+ * taken by other peers first, so transactions to the responder are reconciled.
+ */
+static void ConnectReconcilingPeers(TxReconciliationTracker& initiator, NodeId responder_id, TxReconciliationTracker& responder, NodeId initiator_id)
+{
+    for (NodeId peer = 100; peer < 100 + NodeId(MAX_OUTBOUND_FLOOD_TO); peer++) {
+        initiator.PreRegisterPeer(peer);
+        initiator.RegisterPeer(peer, false, 1, 1);
+    }
+    const uint64_t initiator_salt = initiator.PreRegisterPeer(responder_id);
+    const uint64_t responder_salt = responder.PreRegisterPeer(initiator_id);
+    BOOST_CHECK(initiator.RegisterPeer(responder_id, false, 1, responder_salt) == TxReconciliationTracker::RegisterResult::SUCCESS);
+    BOOST_CHECK(responder.RegisterPeer(initiator_id, true, 1, initiator_salt) == TxReconciliationTracker::RegisterResult::SUCCESS);
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_round)
+{
+    TxReconciliationTracker initiator, responder;
+    ConnectReconcilingPeers(initiator, 1, responder, 0);
+
+    std::set<uint256> only_initiator, only_responder;
+    for (int i = 0; i < 100; i++) {
+        const uint256 shared = InsecureRand256();
+        BOOST_CHECK(initiator.AddToSet(1, shared));
+        BOOST_CHECK(responder.AddToSet(0, shared));
+    }
+    for (int i = 0; i < 10; i++) {
+        only_initiator.insert(InsecureRand256());
+        only_responder.insert(InsecureRand256());
+    }
+    for (const uint256& txid : only_initiator) BOOST_CHECK(initiator.AddToSet(1, txid));
+    for (const uint256& txid : only_responder) BOOST_CHECK(responder.AddToSet(0, txid));
+
+    // Only the initiator sends requests, and only once per interval
+    uint16_t set_size, q;
+    std::vector<unsigned char> sketch;
+    BOOST_CHECK(!responder.InitiateReconciliationRequest(0, std::chrono::seconds{1000}, set_size, q));
+    BOOST_CHECK(initiator.InitiateReconciliationRequest(1, std::chrono::seconds{1000}, set_size, q));
+    BOOST_CHECK_EQUAL(set_size, 110);
+    BOOST_CHECK(!initiator.InitiateReconciliationRequest(1, std::chrono::seconds{1000} + RECON_REQUEST_INTERVAL, set_size, q));
+
+    BOOST_CHECK(responder.HandleReconciliationRequest(0, set_size, q, sketch));
+    BOOST_CHECK_EQUAL(sketch.size(), 4 * TxReconciliationTracker::EstimateSketchCapacity(110, 110, q));
+    // A second request while the round is running is a protocol violation
+    std::vector<unsigned char> second_sketch;
+    BOOST_CHECK(!responder.HandleReconciliationRequest(0, set_size, q, second_sketch));
+
+    bool success;
+    std::vector<uint32_t> ask_shortids;
+    std::vector<uint256> announce;
+    BOOST_CHECK(initiator.HandleSketch(1, sketch, success, ask_shortids, announce));
+    BOOST_CHECK(success);
+    BOOST_CHECK(std::set<uint256>(announce.begin(), announce.end()) == only_initiator);
+    BOOST_CHECK_EQUAL(ask_shortids.size(), only_responder.size());
+
+    BOOST_CHECK(responder.HandleReconciliationDifference(0, success, ask_shortids, announce));
+    BOOST_CHECK(std::set<uint256>(announce.begin(), announce.end()) == only_responder);
+    BOOST_CHECK(!responder.HandleReconciliationDifference(0, success, ask_shortids, announce));
+
+    // The next round starts from empty sets
+    BOOST_CHECK(initiator.InitiateReconciliationRequest(1, std::chrono::seconds{1000} + RECON_REQUEST_INTERVAL, set_size, q));
+    BOOST_CHECK_EQUAL(set_size, 0);
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_fallback)
+{
+    TxReconciliationTracker initiator, responder;
+    ConnectReconcilingPeers(initiator, 1, responder, 0);
+
+    // Too large a difference for a sketch: both sides announce everything
+    std::set<uint256> initiator_set, responder_set;
+    for (uint32_t i = 0; i < MAX_SKETCH_CAPACITY + 5; i++) {
+        initiator_set.insert(InsecureRand256());
+        responder_set.insert(InsecureRand256());
+    }
+    for (const uint256& txid : initiator_set) initiator.AddToSet(1, txid);
+    for (const uint256& txid : responder_set) responder.AddToSet(0, txid);
+    // Transactions the peer announced itself are left out
+    const uint256 announced_by_peer = *responder_set.begin();
+    responder.TryRemovingFromSet(0, announced_by_peer);
+    responder_set.erase(announced_by_peer);
+
+    uint16_t set_size, q;
+    std::vector<unsigned char> sketch;
+    BOOST_CHECK(initiator.InitiateReconciliationRequest(1, std::chrono::seconds{1000}, set_size, q));
+    // Pretend the peer claims an empty set, so the sketch size is decided by ours
+    BOOST_CHECK(responder.HandleReconciliationRequest(0, 0, q, sketch));
+    BOOST_CHECK(sketch.empty());
+
+    bool success;
+    std::vector<uint32_t> ask_shortids;
+    std::vector<uint256> announce;
+    BOOST_CHECK(initiator.HandleSketch(1, sketch, success, ask_shortids, announce));
+    BOOST_CHECK(!success);
+    BOOST_CHECK(ask_shortids.empty());
+    BOOST_CHECK(std::set<uint256>(announce.begin(), announce.end()) == initiator_set);
+
+    BOOST_CHECK(responder.HandleReconciliationDifference(0, success, ask_shortids, announce));
+    BOOST_CHECK(std::set<uint256>(announce.begin(), announce.end()) == responder_set);
+
+    // An oversized sketch is a protocol violation
+    BOOST_CHECK(initiator.InitiateReconciliationRequest(1, std::chrono::seconds{1000} + RECON_REQUEST_INTERVAL, set_size, q));
+    BOOST_CHECK(!initiator.HandleSketch(1, std::vector<unsigned char>(4 * (MAX_SKETCH_CAPACITY + 1)), success, ask_shortids, announce));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -56,7 +56,7 @@ CTxIn MineBlock(const CScript& coinbase_scriptPubKey)
 {
     auto block = PrepareBlock(coinbase_scriptPubKey);
 
-    while (!CheckProofOfWork(block->GetHash(), block->nBits, Params().GetConsensus())) {
+    while (!CheckProofOfWork(block->GetPoWAlgoHash(Params().GetConsensus()), block->nBits, Params().GetConsensus())) {
         ++block->nNonce;
         assert(block->nNonce);
     }
@@ -70,13 +70,23 @@ CTxIn MineBlock(const CScript& coinbase_scriptPubKey)
 
 std::shared_ptr<CBlock> PrepareBlock(const CScript& coinbase_scriptPubKey)
 {
+    // Only scrypt is active before the multi-algo fork; after it, take turns
+    // so as to stay under the limit on sequential blocks of one algo
+    int algo = ALGO_SCRYPT;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* tip = ::ChainActive().Tip();
+        if (IsAlgoActive(tip, Params().GetConsensus(), ALGO_SHA256D)) algo = tip->nHeight % NUM_ALGOS;
+    }
     auto block = std::make_shared<CBlock>(
         BlockAssembler{Params()}
-            .CreateNewBlock(coinbase_scriptPubKey, 2)
+            .CreateNewBlock(coinbase_scriptPubKey, algo)
             ->block);
 
     LOCK(cs_main);
     block->nTime = ::ChainActive().Tip()->GetMedianTimePast() + 1;
+    // The retarget depends on the block time
+    block->nBits = GetNextWorkRequired(::ChainActive().Tip(), block.get(), Params().GetConsensus(), algo);
     block->hashMerkleRoot = BlockMerkleRoot(*block);
 
     return block;
@@ -5,6 +5,8 @@
 
 #include <chainparams.h>
 #include <net.h>
+#include <streams.h>
+#include <txdb.h>
 #include <validation.h>
 
 #include <test/setup_common.h>
@@ -59,6 +61,72 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK_EQUAL(nSum, CAmount{2099999997690000});
 }
 
+BOOST_AUTO_TEST_CASE(raw_block_witness_free)
+{
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_0 << OP_0;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 50 * COIN;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    std::vector<uint8_t> block_data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, block_data, 0, block);
+    BOOST_CHECK(IsRawBlockWitnessFree(block_data));
+
+    // Witness reserved value in the coinbase switches to the extended format
+    coinbase.vin[0].scriptWitness.stack.resize(1);
+    coinbase.vin[0].scriptWitness.stack[0].resize(32);
+    block.vtx[0] = MakeTransactionRef(coinbase);
+    block_data.clear();
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, block_data, 0, block);
+    BOOST_CHECK(!IsRawBlockWitnessFree(block_data));
+
+    // Truncated data is never treated as witness-free
+    block_data.resize(80);
+    BOOST_CHECK(!IsRawBlockWitnessFree(block_data));
+}
+
+BOOST_AUTO_TEST_CASE(block_index_snapshot)
+{
+    LOCK(cs_main);
+    ::ChainstateActive().ForceFlushStateToDisk();
+    const CBlockIndex* tip = ::ChainActive().Tip();
+    BOOST_CHECK(DumpBlockIndexSnapshot());
+
+    BlockManager blockman;
+    std::vector<std::pair<int, CBlockIndex*>> sorted_by_height;
+    BOOST_CHECK(blockman.LoadSnapshot(Params().GetConsensus(), *pblocktree, sorted_by_height));
+    BOOST_CHECK_EQUAL(blockman.m_block_index.size(), BlockIndex().size());
+    BOOST_CHECK_EQUAL(sorted_by_height.size(), BlockIndex().size());
+    for (const BlockMap::value_type& entry : BlockIndex()) {
+        const CBlockIndex* original = entry.second;
+        const CBlockIndex* loaded = blockman.m_block_index.at(entry.first);
+        BOOST_CHECK(loaded->GetBlockHash() == original->GetBlockHash());
+        BOOST_CHECK(loaded->GetBlockHeader().GetHash() == original->GetBlockHash());
+        BOOST_CHECK_EQUAL(loaded->nHeight, original->nHeight);
+        BOOST_CHECK_EQUAL(loaded->nStatus, original->nStatus);
+        BOOST_CHECK_EQUAL(loaded->nTx, original->nTx);
+        BOOST_CHECK(loaded->nChainWork == original->nChainWork);
+        BOOST_CHECK_EQUAL(loaded->nTimeMax, original->nTimeMax);
+        BOOST_CHECK_EQUAL(loaded->pskip ? loaded->pskip->nHeight : -1, original->pskip ? original->pskip->nHeight : -1);
+    }
+    BOOST_CHECK(blockman.m_block_index.at(tip->GetBlockHash())->GetAncestor(0)->GetBlockHash() == Params().GetConsensus().hashGenesisBlock);
+
+    // The snapshot is single use, and any block index write invalidates it
+    BlockManager blockman2;
+    sorted_by_height.clear();
+    BOOST_CHECK(!blockman2.LoadSnapshot(Params().GetConsensus(), *pblocktree, sorted_by_height));
+    BOOST_CHECK(DumpBlockIndexSnapshot());
+    BOOST_CHECK(pblocktree->WriteBatchSync({}, 0, {}));
+    BOOST_CHECK(!blockman2.LoadSnapshot(Params().GetConsensus(), *pblocktree, sorted_by_height));
+    BOOST_CHECK(blockman2.m_block_index.empty());
+
+    blockman.Unload();
+}
+
 static bool ReturnFalse() { return false; }
 static bool ReturnTrue() { return true; }
 
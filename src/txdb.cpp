@@ -32,6 +32,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_INDEX_SNAPSHOT = 'S';
 
 namespace {
 
@@ -368,9 +369,27 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    batch.Erase(DB_BLOCK_INDEX_SNAPSHOT);
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteBlockIndexSnapshotMarker(const uint256& nonce, const uint256& tip) {
+    return Write(DB_BLOCK_INDEX_SNAPSHOT, std::make_pair(nonce, tip), true);
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshotMarker(uint256& nonce, uint256& tip) {
+    std::pair<uint256, uint256> marker;
+    if (!Read(DB_BLOCK_INDEX_SNAPSHOT, marker))
+        return false;
+    nonce = marker.first;
+    tip = marker.second;
+    return true;
+}
+
+bool CBlockTreeDB::EraseBlockIndexSnapshotMarker() {
+    return Erase(DB_BLOCK_INDEX_SNAPSHOT, true);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
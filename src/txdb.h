@@ -121,6 +121,11 @@ public:
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! The marker ties a block index snapshot file to the database state it was taken from.
+    //! Any later WriteBatchSync erases it.
+    bool WriteBlockIndexSnapshotMarker(const uint256& nonce, const uint256& tip);
+    bool ReadBlockIndexSnapshotMarker(uint256& nonce, uint256& tip);
+    bool EraseBlockIndexSnapshotMarker();
 };
 
 #endif // AURORACOIN_TXDB_H
@@ -115,6 +115,8 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // Use a set for lookups into vHashesToUpdate (these entries are already
     // accounted for in the state of their ancestors)
     std::set<uint256> setAlreadyIncluded(vHashesToUpdate.begin(), vHashesToUpdate.end());
+    // The re-added transactions whose children were linked, which merges their clusters
+    setEntries setLinked;
 
     // Iterate in reverse, so that whenever we are looking at a transaction
     // we are sure that all in-mempool descendants have already been processed.
@@ -141,10 +143,12 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
             if (setChildren.insert(childIter).second && !setAlreadyIncluded.count(childHash)) {
                 UpdateChild(it, childIter, true);
                 UpdateParent(childIter, it, true);
+                setLinked.insert(it);
             }
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    UpdateClusters(setLinked);
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -393,6 +397,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     }
     UpdateAncestorsOf(true, newit, setAncestors);
     UpdateEntryForAncestors(newit, setAncestors);
+    UpdateClusters({newit});
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
@@ -721,6 +726,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    mapClusters.clear();
+    setClusterTails.clear();
+    cachedClusterUsage = 0;
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -737,6 +745,11 @@ void CTxMemPool::clear()
     _clear();
 }
 
+static bool HigherFeeRate(CAmount fee_a, int64_t size_a, CAmount fee_b, int64_t size_b)
+{
+    return (double)fee_a * size_b > (double)fee_b * size_a;
+}
+
 static void CheckInputsAndUpdateCoins(const CTransaction& tx, CCoinsViewCache& mempoolDuplicate, const int64_t spendheight)
 {
     CValidationState state;
@@ -860,6 +873,45 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+
+    // Check that the clusters cover the mempool, each transaction after its
+    // parents, in chunks of decreasing feerate
+    size_t nClustered = 0;
+    uint64_t clusterUsage = 0;
+    for (const auto& entry : mapClusters) {
+        const Cluster& cluster = entry.second;
+        setEntries setSeen;
+        int64_t nSizeCheck = 0;
+        for (txiter it : cluster.linearization) {
+            assert(mapLinks.at(it).cluster == entry.first);
+            for (txiter parent : GetMemPoolParents(it)) {
+                assert(setSeen.count(parent));
+            }
+            setSeen.insert(it);
+            nSizeCheck += it->GetTxSize();
+        }
+        assert(cluster.size == nSizeCheck);
+        size_t begin = 0;
+        for (size_t c = 0; c < cluster.chunks.size(); ++c) {
+            const Chunk& chunk = cluster.chunks[c];
+            CAmount nFeesCheck = 0;
+            int64_t nChunkSizeCheck = 0;
+            for (size_t i = begin; i < chunk.end; ++i) {
+                nFeesCheck += cluster.linearization[i]->GetModifiedFee();
+                nChunkSizeCheck += cluster.linearization[i]->GetTxSize();
+            }
+            assert(chunk.fee == nFeesCheck && chunk.size == nChunkSizeCheck);
+            assert(c == 0 || HigherFeeRate(cluster.chunks[c - 1].fee, cluster.chunks[c - 1].size, chunk.fee, chunk.size));
+            begin = chunk.end;
+        }
+        assert(begin == cluster.linearization.size());
+        assert(setClusterTails.count(ClusterTail{cluster.chunks.back().fee, cluster.chunks.back().size, entry.first}));
+        nClustered += cluster.linearization.size();
+        clusterUsage += memusage::DynamicUsage(cluster.linearization) + memusage::DynamicUsage(cluster.chunks);
+    }
+    assert(nClustered == mapTx.size());
+    assert(setClusterTails.size() == mapClusters.size());
+    assert(clusterUsage == cachedClusterUsage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -980,6 +1032,8 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            // The new fee may order the cluster differently
+            UpdateClusters({it});
             ++nTransactionsUpdated;
         }
     }
@@ -1054,15 +1108,29 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage + memusage::DynamicUsage(mapClusters) + memusage::DynamicUsage(setClusterTails) + cachedClusterUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
+    // What is left of the clusters of the removed transactions is reachable
+    // from the transactions linked to them, which may now be in different
+    // clusters.
+    setEntries setLeftBehind;
+    for (txiter it : stage) {
+        const TxLinks& links = mapLinks.at(it);
+        for (const setEntries* linked : {&links.parents, &links.children}) {
+            for (txiter linkedIt : *linked) {
+                if (!stage.count(linkedIt)) setLeftBehind.insert(linkedIt);
+            }
+        }
+        EraseCluster(links.cluster);
+    }
     UpdateForRemoveFromMempool(stage, updateDescendants);
     for (txiter it : stage) {
         removeUnchecked(it, reason);
     }
+    UpdateClusters(setLeftBehind);
 }
 
 int CTxMemPool::Expire(int64_t time) {
@@ -1164,19 +1232,22 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        // The lowest feerate chunk is the last of its cluster, so nothing left
+        // in the mempool spends from it.
+        const ClusterTail tail = *setClusterTails.begin();
+        const Cluster& cluster = mapClusters.at(tail.cluster);
+        const size_t begin = cluster.chunks.size() > 1 ? cluster.chunks[cluster.chunks.size() - 2].end : 0;
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        CFeeRate removed(tail.fee, tail.size);
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        setEntries stage(cluster.linearization.begin() + begin, cluster.linearization.end());
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1233,6 +1304,158 @@ void CTxMemPool::GetTransactionAncestry(const uint256& txid, size_t& ancestors,
     }
 }
 
+bool CTxMemPool::CheckClusterLimits(const setEntries& setAncestors, int64_t entrySize, uint64_t limitClusterCount, uint64_t limitClusterSize, std::string& errString) const
+{
+    // Every ancestor is in the cluster of one of the parents
+    std::set<uint64_t> setClusters;
+    uint64_t nClusterCount = 1;
+    uint64_t nClusterSize = entrySize;
+    for (txiter ancestorIt : setAncestors) {
+        const uint64_t id = mapLinks.at(ancestorIt).cluster;
+        if (!setClusters.insert(id).second) continue;
+        const Cluster& cluster = mapClusters.at(id);
+        nClusterCount += cluster.linearization.size();
+        nClusterSize += cluster.size;
+    }
+    if (nClusterCount > limitClusterCount) {
+        errString = strprintf("too many transactions in cluster [limit: %u]", limitClusterCount);
+        return false;
+    }
+    if (nClusterSize > limitClusterSize) {
+        errString = strprintf("exceeds cluster size limit [limit: %u]", limitClusterSize);
+        return false;
+    }
+    return true;
+}
+
+const CTxMemPool::Cluster& CTxMemPool::GetCluster(txiter entry) const
+{
+    return mapClusters.at(mapLinks.at(entry).cluster);
+}
+
+bool CTxMemPool::ClusterTail::operator<(const ClusterTail& other) const
+{
+    if (HigherFeeRate(fee, size, other.fee, other.size)) return false;
+    if (HigherFeeRate(other.fee, other.size, fee, size)) return true;
+    return cluster < other.cluster;
+}
+
+void CTxMemPool::UpdateClusters(const setEntries& entries)
+{
+    setEntries setVisited;
+    for (txiter root : entries) {
+        if (!setVisited.insert(root).second) continue;
+        std::vector<txiter> members{root};
+        for (size_t i = 0; i < members.size(); ++i) {
+            const TxLinks& links = mapLinks.at(members[i]);
+            for (const setEntries* linked : {&links.parents, &links.children}) {
+                for (txiter linkedIt : *linked) {
+                    if (setVisited.insert(linkedIt).second) members.push_back(linkedIt);
+                }
+            }
+        }
+
+        const uint64_t id = nNextClusterId++;
+        for (txiter it : members) {
+            uint64_t& cluster = mapLinks.at(it).cluster;
+            EraseCluster(cluster);
+            cluster = id;
+        }
+        Cluster& cluster = mapClusters[id];
+        LinearizeCluster(std::move(members), cluster);
+        setClusterTails.insert(ClusterTail{cluster.chunks.back().fee, cluster.chunks.back().size, id});
+        cachedClusterUsage += memusage::DynamicUsage(cluster.linearization) + memusage::DynamicUsage(cluster.chunks);
+    }
+}
+
+// Builds the linearization by repeatedly taking the remaining transaction
+// whose remaining ancestors have the highest feerate, together with those
+// ancestors, then merges each transaction into the chunk before it for as
+// long as that chunk has a lower feerate.
+void CTxMemPool::LinearizeCluster(std::vector<txiter> members, Cluster& cluster) const
+{
+    // If a transaction A depends on transaction B, then A's ancestor count
+    // must be greater than B's, so this is a valid order to start from.
+    std::sort(members.begin(), members.end(), [](txiter a, txiter b) {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors()) {
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        }
+        return CompareIteratorByHash()(a, b);
+    });
+    const size_t n = members.size();
+    std::map<txiter, size_t, CompareIteratorByHash> mapIndex;
+    for (size_t i = 0; i < n; ++i) {
+        mapIndex.emplace(members[i], i);
+    }
+
+    // In-cluster ancestors and descendants of each transaction, by index
+    std::vector<std::vector<bool>> ancestors(n, std::vector<bool>(n, false));
+    std::vector<std::vector<size_t>> descendants(n);
+    std::vector<CAmount> fees(n), ancestorFees(n);
+    std::vector<int64_t> sizes(n), ancestorSizes(n);
+    for (size_t i = 0; i < n; ++i) {
+        for (txiter parent : mapLinks.at(members[i]).parents) {
+            const size_t p = mapIndex.at(parent);
+            ancestors[i][p] = true;
+            for (size_t a = 0; a < p; ++a) {
+                if (ancestors[p][a]) ancestors[i][a] = true;
+            }
+        }
+        fees[i] = ancestorFees[i] = members[i]->GetModifiedFee();
+        sizes[i] = ancestorSizes[i] = members[i]->GetTxSize();
+        for (size_t a = 0; a < i; ++a) {
+            if (!ancestors[i][a]) continue;
+            descendants[a].push_back(i);
+            ancestorFees[i] += fees[a];
+            ancestorSizes[i] += sizes[a];
+        }
+    }
+
+    cluster.linearization.clear();
+    cluster.linearization.reserve(n);
+    cluster.chunks.clear();
+    cluster.size = 0;
+    std::vector<bool> done(n, false);
+    while (cluster.linearization.size() < n) {
+        size_t best = n;
+        for (size_t i = 0; i < n; ++i) {
+            if (done[i]) continue;
+            if (best == n || HigherFeeRate(ancestorFees[i], ancestorSizes[i], ancestorFees[best], ancestorSizes[best])) best = i;
+        }
+        for (size_t i = 0; i <= best; ++i) {
+            if (done[i] || (i != best && !ancestors[best][i])) continue;
+            done[i] = true;
+            for (size_t d : descendants[i]) {
+                ancestorFees[d] -= fees[i];
+                ancestorSizes[d] -= sizes[i];
+            }
+            cluster.linearization.push_back(members[i]);
+            cluster.size += sizes[i];
+
+            Chunk chunk;
+            chunk.fee = fees[i];
+            chunk.size = sizes[i];
+            chunk.end = cluster.linearization.size();
+            while (!cluster.chunks.empty() && !HigherFeeRate(cluster.chunks.back().fee, cluster.chunks.back().size, chunk.fee, chunk.size)) {
+                chunk.fee += cluster.chunks.back().fee;
+                chunk.size += cluster.chunks.back().size;
+                cluster.chunks.pop_back();
+            }
+            cluster.chunks.push_back(chunk);
+        }
+    }
+}
+
+void CTxMemPool::EraseCluster(uint64_t id)
+{
+    auto it = mapClusters.find(id);
+    if (it == mapClusters.end()) return;
+    const Chunk& tail = it->second.chunks.back();
+    setClusterTails.erase(ClusterTail{tail.fee, tail.size, id});
+    cachedClusterUsage -= memusage::DynamicUsage(it->second.linearization) + memusage::DynamicUsage(it->second.chunks);
+    mapClusters.erase(it);
+}
+
 bool CTxMemPool::IsLoaded() const
 {
     LOCK(cs);
@@ -435,12 +435,25 @@ public:
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
+ * Clusters:
+ *
+ * Transactions connected to each other through in-mempool spends, in either
+ * direction, form a cluster. Each cluster keeps a linearization, an order of
+ * its transactions that puts every transaction after its in-mempool parents,
+ * split into chunks of decreasing feerate. The block assembler takes the
+ * chunks of all clusters best feerate first, and TrimToSize() evicts the
+ * lowest feerate chunk, which is always the last chunk of its cluster. A
+ * cluster is rebuilt whenever a transaction joins or leaves it, or has its fee
+ * prioritised, in time that depends only on the size of the cluster.
+ *
  * Computational limits:
  *
  * Updating all in-mempool ancestors of a newly added transaction can be slow,
  * if no bound exists on how many in-mempool ancestors there may be.
  * CalculateMemPoolAncestors() takes configurable limits that are designed to
- * prevent these calculations from being too CPU intensive.
+ * prevent these calculations from being too CPU intensive. CheckClusterLimits()
+ * bounds the size of the cluster a new transaction would join, which bounds
+ * the work of rebuilding it.
  *
  */
 class CTxMemPool
@@ -534,17 +547,50 @@ public:
     const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** A run of a cluster's linearization that is mined, or evicted, as a whole. */
+    struct Chunk {
+        CAmount fee{0};  //!< modified fees of the chunk's transactions
+        int64_t size{0}; //!< virtual size of the chunk's transactions
+        size_t end{0};   //!< one past the chunk's last transaction in the linearization
+    };
+
+    struct Cluster {
+        //! every transaction comes after its in-mempool parents
+        std::vector<txiter> linearization;
+        //! the linearization in runs of decreasing feerate
+        std::vector<Chunk> chunks;
+        int64_t size{0};
+    };
+    typedef std::map<uint64_t, Cluster> clusterMap;
+
+    const clusterMap& GetClusters() const EXCLUSIVE_LOCKS_REQUIRED(cs) { return mapClusters; }
+    const Cluster& GetCluster(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
         setEntries children;
+        uint64_t cluster{0};
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /** The last chunk of a cluster, ordered by feerate. */
+    struct ClusterTail {
+        CAmount fee;
+        int64_t size;
+        uint64_t cluster;
+        bool operator<(const ClusterTail& other) const;
+    };
+
+    clusterMap mapClusters GUARDED_BY(cs);
+    std::set<ClusterTail> setClusterTails GUARDED_BY(cs); //!< lowest feerate first
+    uint64_t nNextClusterId GUARDED_BY(cs){1};
+    uint64_t cachedClusterUsage GUARDED_BY(cs){0}; //!< dynamic memory usage of the clusters' vectors
+
     typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
     addressDeltaMap mapAddress;
 
@@ -667,6 +713,12 @@ public:
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Check that the cluster of a new transaction with the given in-mempool
+     *  ancestors, which merges the clusters of all of them, stays within
+     *  limitClusterCount transactions and limitClusterSize virtual bytes.
+     *  errString = populated with error reason if any limits are hit */
+    bool CheckClusterLimits(const setEntries& setAncestors, int64_t entrySize, uint64_t limitClusterCount, uint64_t limitClusterSize, std::string& errString) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
       *  The incrementalRelayFee policy variable is used to bound the time it
@@ -751,6 +803,13 @@ private:
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /** Rebuild the clusters containing the given transactions from mapLinks,
+     *  replacing any cluster they were in before. */
+    void UpdateClusters(const setEntries& entries) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Linearize and chunk the transactions of a cluster. */
+    void LinearizeCluster(std::vector<txiter> members, Cluster& cluster) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void EraseCluster(uint64_t id) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /** Before calling removeUnchecked for a given transaction,
      *  UpdateForRemoveFromMempool must be called on the entire (dependent) set
      *  of transactions being removed at the same time.  We use each
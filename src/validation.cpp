@@ -19,6 +19,7 @@
 #include <flatfile.h>
 #include <hash.h>
 #include <index/txindex.h>
+#include <node/utxo_snapshot.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/settings.h>
@@ -42,14 +43,18 @@
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 #include <util/validation.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
 #include <future>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -190,6 +195,7 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
@@ -429,7 +435,7 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
         }
     }
 
-    return CheckInputs(tx, state, view, flags, cacheSigStore, true, txdata);
+    return CheckInputsParallel(tx, state, view, flags, cacheSigStore, true, txdata);
 }
 
 namespace {
@@ -441,7 +447,9 @@ public:
         m_limit_ancestors(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
         m_limit_ancestor_size(gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
         m_limit_descendants(gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {}
+        m_limit_descendant_size(gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000),
+        m_limit_cluster(gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT)),
+        m_limit_cluster_size(gArgs.GetArg("-limitclustersize", DEFAULT_CLUSTER_SIZE_LIMIT)*1000) {}
 
     // We put the arguments we're handed into a struct, so we can pass them
     // around easier.
@@ -534,6 +542,8 @@ private:
     // in-mempool conflicts; see below).
     size_t m_limit_descendants;
     size_t m_limit_descendant_size;
+    const size_t m_limit_cluster;
+    const size_t m_limit_cluster_size;
 };
 
 bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
@@ -782,6 +792,12 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
+    // Rebuilding the cluster the transaction joins takes time that grows with
+    // its size, which the ancestor and descendant limits do not bound.
+    if (!m_pool.CheckClusterLimits(setAncestors, nSize, m_limit_cluster, m_limit_cluster_size, errString)) {
+        return state.Invalid(ValidationInvalidReason::TX_MEMPOOL_POLICY, false, REJECT_NONSTANDARD, "too-large-mempool-cluster", errString);
+    }
+
     // A transaction that spends outputs that would be replaced by it is invalid. Now
     // that we have the set of all ancestors we can detect this
     // pathological case by making sure setConflicts and setAncestors don't
@@ -925,7 +941,7 @@ bool MemPoolAccept::PolicyScriptChecks(ATMPArgs& args, Workspace& ws, Precompute
 
     // Check against previous transactions
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputs(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
+    if (!CheckInputsParallel(tx, state, m_view, scriptVerifyFlags, true, false, txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1067,8 +1083,8 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef& ptx, ATMPArgs
 
 } // anon namespace
 
-/** (try to) add transaction to memory pool with a specified acceptance time **/
-static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
+/** AcceptToMemoryPoolWithTime, leaving it to the caller to keep the coins cache within its size limits **/
+static bool AcceptToMemoryPoolWithTimeNoFlush(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
@@ -1084,6 +1100,15 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
         for (const COutPoint& hashTx : coins_to_uncache)
             ::ChainstateActive().CoinsTip().Uncache(hashTx);
     }
+    return res;
+}
+
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx,
+                        bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                        bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    bool res = AcceptToMemoryPoolWithTimeNoFlush(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
     CValidationState stateDummy;
     ::ChainstateActive().FlushStateToDisk(chainparams, stateDummy, FlushStateMode::PERIODIC);
@@ -1098,6 +1123,69 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+/** Order txs so that parents come before their children (Kahn's algorithm),
+ * keeping the given order among transactions that are ready. */
+static std::vector<size_t> TopologicalOrder(const std::vector<CTransactionRef>& txs)
+{
+    std::map<uint256, size_t> batch_index;
+    for (size_t i = 0; i < txs.size(); i++) {
+        batch_index.emplace(txs[i]->GetHash(), i);
+    }
+    std::vector<std::vector<size_t>> children(txs.size());
+    std::vector<size_t> pending_parents(txs.size(), 0);
+    for (size_t i = 0; i < txs.size(); i++) {
+        std::set<size_t> parents;
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = batch_index.find(txin.prevout.hash);
+            if (it != batch_index.end() && it->second != i) parents.insert(it->second);
+        }
+        for (size_t parent : parents) {
+            children[parent].push_back(i);
+        }
+        pending_parents[i] = parents.size();
+    }
+    std::vector<size_t> order;
+    order.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (pending_parents[i] == 0) order.push_back(i);
+    }
+    for (size_t next = 0; next < order.size(); next++) {
+        for (size_t child : children[order[next]]) {
+            if (--pending_parents[child] == 0) order.push_back(child);
+        }
+    }
+    assert(order.size() == txs.size());
+    return order;
+}
+
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& nAbsurdFees,
+                        std::vector<CValidationState>& states, std::vector<bool>& missing_inputs)
+{
+    AssertLockHeld(cs_main);
+    assert(nAbsurdFees.size() == txs.size());
+    const CChainParams& chainparams = Params();
+    const int64_t nAcceptTime = GetTime();
+
+    const std::vector<size_t> order = TopologicalOrder(txs);
+    states.assign(txs.size(), CValidationState());
+    missing_inputs.assign(txs.size(), false);
+    std::vector<bool> accepted(txs.size(), false);
+    {
+        LOCK(pool.cs);
+        for (size_t i : order) {
+            bool fMissingInputs = false;
+            accepted[i] = AcceptToMemoryPoolWithTimeNoFlush(chainparams, pool, states[i], txs[i], &fMissingInputs, nAcceptTime,
+                                                            nullptr /* plTxnReplaced */, false /* bypass_limits */, nAbsurdFees[i], false /* test_accept */);
+            missing_inputs[i] = fMissingInputs;
+        }
+    }
+
+    // Ensure our coins cache is still within its size limits, once for the whole batch
+    CValidationState stateDummy;
+    ::ChainstateActive().FlushStateToDisk(chainparams, stateDummy, FlushStateMode::PERIODIC);
+    return accepted;
+}
+
 bool GetTimestampIndex(const unsigned int& high, const unsigned int& low, std::vector<uint256>& hashes)
 {
     if (!fTimestampIndex)
@@ -1296,6 +1384,25 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+bool IsRawBlockWitnessFree(const std::vector<uint8_t>& block)
+{
+    // A block with witness data must commit to it in the coinbase, which in
+    // turn must carry the witness reserved value (see CheckWitnessMalleation),
+    // so looking at the coinbase serialization is enough. The coinbase has
+    // exactly one input, so a zero byte where the input count is expected can
+    // only be the extended-format marker.
+    size_t pos = 80; // block header
+    if (block.size() <= pos) return false;
+    const uint8_t tx_count_prefix = block[pos];
+    if (tx_count_prefix < 253) pos += 1;
+    else if (tx_count_prefix == 253) pos += 3;
+    else if (tx_count_prefix == 254) pos += 5;
+    else pos += 9;
+    pos += 4; // coinbase nVersion
+    if (block.size() <= pos) return false;
+    return block[pos] != 0;
+}
+
 // GetBlockSubsidy consensusParams is a Digibytism
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
@@ -1535,6 +1642,16 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    // Run the script first, then verify the signatures that have to be valid
+    // for it to pass in one go, skipping them if the script fails anyway.
+    std::vector<DeferredSignature> deferred;
+    if (!VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, &deferred), &error)) {
+        return false;
+    }
+    if (VerifyDeferredSignatures(deferred, cacheStore)) {
+        return true;
+    }
+    // Run it again verifying each signature in place, for the error of the one that failed
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
@@ -1546,9 +1663,19 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 }
 
 
-static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static ShardedCuckooCache scriptExecutionCache;
 static uint256 scriptExecutionCacheNonce(GetRandHash());
 
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    // We only use the first 19 bytes of nonce to avoid a second SHA
+    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
 void InitScriptExecutionCache() {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
@@ -1588,12 +1715,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    // We only use the first 19 bytes of nonce to avoid a second SHA
-    // round - giving us 19 + 32 + 4 = 55 bytes (+ 8 + 1 = 64)
-    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
-    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
-    AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
+    const uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
     if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
     }
@@ -1942,6 +2064,42 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * CheckInputs for a loose transaction, as when it enters the mempool. With
+ * enough inputs the script checks are shared with the script-checking threads
+ * instead of all running on the calling thread, which holds cs_main and the
+ * mempool lock meanwhile. Blocks are connected under cs_main too, so the queue
+ * is never needed by both at once.
+ *
+ * A queued check does not say which input failed or why, so on failure the
+ * inputs are checked again serially to fill in state exactly as CheckInputs
+ * would. The signatures that passed are in the signature cache by then.
+ */
+static bool CheckInputsParallel(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (nScriptCheckThreads == 0 || tx.vin.size() < MIN_PARALLEL_MEMPOOL_SCRIPT_CHECK_INPUTS) {
+        return CheckInputs(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    std::vector<CScriptCheck> vChecks;
+    if (!CheckInputs(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata, &vChecks)) {
+        return false;
+    }
+    // Nothing queued: the script execution cache already had the result
+    if (vChecks.empty()) return true;
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(vChecks);
+    if (!control.Wait()) {
+        return CheckInputs(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+    if (cacheFullScriptStore) {
+        scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    }
+    return true;
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params, int algo)
@@ -3372,7 +3530,7 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3825,7 +3983,7 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     return true;
 }
 
-bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fCheckPOW)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
@@ -3843,7 +4001,7 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus()))
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), fCheckPOW))
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
         // Get prev block index
@@ -3905,14 +4063,14 @@ bool BlockManager::AcceptBlockHeader(const CBlockHeader& block, CValidationState
 }
 
 // Exposed wrapper for AcceptBlockHeader
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid)
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader *first_invalid, bool fCheckPOW)
 {
     if (first_invalid != nullptr) first_invalid->SetNull();
     {
         LOCK(cs_main);
         for (const CBlockHeader& header : headers) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex);
+            bool accepted = g_blockman.AcceptBlockHeader(header, state, chainparams, &pindex, fCheckPOW);
             ::ChainstateActive().CheckBlockIndex(chainparams.GetConsensus());
 
             if (!accepted) {
@@ -3962,7 +4120,8 @@ bool CChainState::AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CVali
     CBlockIndex *pindexDummy = nullptr;
     CBlockIndex *&pindex = ppindex ? *ppindex : pindexDummy;
 
-    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex);
+    // A block that already passed CheckBlock had its proof of work verified
+    bool accepted_header = m_blockman.AcceptBlockHeader(block, state, chainparams, &pindex, !block.fChecked);
     CheckBlockIndex(chainparams.GetConsensus());
 
     if (!accepted_header)
@@ -4297,36 +4456,235 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = m_block_index_arena.Allocate();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
-bool BlockManager::LoadBlockIndex(
+void BlockManager::RelocateBlockIndex(std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height)
+{
+    // Entries were allocated in database (hash) order; lay them out again in
+    // height order so that walks along a chain touch consecutive memory.
+    // Nothing else references the entries yet, and pskip is not built yet,
+    // so it serves as forwarding pointer from the old entry to its copy.
+    CBlockIndexArena sorted_arena;
+    sorted_arena.Reserve(sorted_by_height.size());
+    for (std::pair<int, CBlockIndex*>& item : sorted_by_height)
+    {
+        CBlockIndex* pindexOld = item.second;
+        CBlockIndex* pindexNew = sorted_arena.Allocate(*pindexOld);
+        // Parents have a lower height and were moved already
+        if (pindexNew->pprev) pindexNew->pprev = pindexNew->pprev->pskip;
+        pindexOld->pskip = pindexNew;
+        item.second = pindexNew;
+    }
+    for (BlockMap::value_type& entry : m_block_index) {
+        entry.second = entry.second->pskip;
+    }
+    m_block_index_arena.swap(sorted_arena);
+}
+
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blockindex.dat";
+}
+
+template <typename Stream>
+static void SerializeSnapshotEntry(Stream& s, const CBlockIndex& index, int32_t prev, int32_t skip)
+{
+    s << index.GetBlockHash() << prev << skip;
+    s << index.nHeight << index.nFile << index.nDataPos << index.nUndoPos;
+    s << ArithToUint256(index.nChainWork) << index.nTx << index.nStatus << index.nTimeMax;
+    s << index.nVersion << index.hashMerkleRoot << index.nTime << index.nBits << index.nNonce;
+}
+
+template <typename Stream>
+static void UnserializeSnapshotEntry(Stream& s, CBlockIndex& index, uint256& hash, int32_t& prev, int32_t& skip)
+{
+    uint256 chain_work;
+    s >> hash >> prev >> skip;
+    s >> index.nHeight >> index.nFile >> index.nDataPos >> index.nUndoPos;
+    s >> chain_work >> index.nTx >> index.nStatus >> index.nTimeMax;
+    s >> index.nVersion >> index.hashMerkleRoot >> index.nTime >> index.nBits >> index.nNonce;
+    index.nChainWork = UintToArith256(chain_work);
+}
+
+bool BlockManager::WriteSnapshot(CBlockTreeDB& blocktree, const CBlockIndex* tip)
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    if (!setDirtyBlockIndex.empty() || !tip) return false;
+
+    std::vector<const CBlockIndex*> entries;
+    entries.reserve(m_block_index.size());
+    for (const BlockMap::value_type& entry : m_block_index) {
+        entries.push_back(entry.second);
+    }
+    std::sort(entries.begin(), entries.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+        return a->nHeight < b->nHeight || (a->nHeight == b->nHeight && a < b);
+    });
+    std::unordered_map<const CBlockIndex*, int32_t> positions;
+    positions.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        positions.emplace(entries[i], i);
+    }
+    auto position = [&positions](const CBlockIndex* pindex) {
+        return pindex ? positions.at(pindex) : -1;
+    };
+
+    const uint256 nonce = GetRandHash();
+    const fs::path path = GetBlockIndexSnapshotPath();
+    const fs::path path_new = path.string() + ".new";
+    try {
+        FILE* filestr = fsbridge::fopen(path_new, "wb");
+        if (!filestr) {
+            return error("%s: Failed to open %s", __func__, path_new.string());
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        CDataStream record(SER_DISK, CLIENT_VERSION);
+
+        record << BLOCK_INDEX_SNAPSHOT_VERSION << nonce << tip->GetBlockHash() << (uint64_t)entries.size();
+        for (const CBlockIndex* pindex : entries) {
+            SerializeSnapshotEntry(record, *pindex, position(pindex->pprev), position(pindex->pskip));
+            // Flush in large chunks rather than per entry
+            if (record.size() >= (1 << 20)) {
+                hasher.write(record.data(), record.size());
+                file.write(record.data(), record.size());
+                record.clear();
+            }
+        }
+        hasher.write(record.data(), record.size());
+        file.write(record.data(), record.size());
+        file << hasher.GetHash();
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(path_new, path);
+    } catch (const std::exception& e) {
+        return error("%s: Failed to write block index snapshot: %s", __func__, e.what());
+    }
+    if (!blocktree.WriteBlockIndexSnapshotMarker(nonce, tip->GetBlockHash())) {
+        return error("%s: Failed to write block index snapshot marker", __func__);
+    }
+    LogPrintf("Wrote block index snapshot with %u entries in %dms\n", entries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool BlockManager::LoadSnapshot(
     const Consensus::Params& consensus_params,
     CBlockTreeDB& blocktree,
-    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+    std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMillis();
+
+    if (!m_block_index.empty() || !gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT)) return false;
+
+    uint256 marker_nonce, marker_tip;
+    if (!blocktree.ReadBlockIndexSnapshotMarker(marker_nonce, marker_tip)) return false;
+    // The snapshot is only valid for the database state it was taken from
+    blocktree.EraseBlockIndexSnapshotMarker();
+
+    const fs::path path = GetBlockIndexSnapshotPath();
+    FILE* filestr = fsbridge::fopen(path, "rb");
+    if (!filestr) {
+        LogPrintf("Block index snapshot %s not found, loading block index from database\n", path.string());
         return false;
+    }
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
-    // Calculate nChainWork
+    CBlockIndexArena arena;
+    std::vector<std::pair<uint256, CBlockIndex*>> entries;
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint32_t version;
+        uint256 nonce, tip;
+        uint64_t count;
+        verifier >> version >> nonce >> tip >> count;
+        if (version != BLOCK_INDEX_SNAPSHOT_VERSION || nonce != marker_nonce || tip != marker_tip || count > (uint64_t)std::numeric_limits<int32_t>::max()) {
+            LogPrintf("Block index snapshot does not match the database, loading block index from database\n");
+            return false;
+        }
+        arena.Reserve(count);
+        entries.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            if (i % 100000 == 0 && ShutdownRequested()) return false;
+            CBlockIndex* pindex = arena.Allocate();
+            uint256 hash;
+            int32_t prev, skip;
+            UnserializeSnapshotEntry(verifier, *pindex, hash, prev, skip);
+            // Entries are in height order, so pprev and pskip point backwards
+            if (prev >= (int64_t)i || skip >= (int64_t)i || prev < -1 || skip < -1) {
+                throw std::ios_base::failure("invalid entry reference");
+            }
+            pindex->pprev = prev < 0 ? nullptr : entries[prev].second;
+            pindex->pskip = skip < 0 ? nullptr : entries[skip].second;
+            entries.emplace_back(hash, pindex);
+        }
+        uint256 checksum;
+        file >> checksum;
+        if (checksum != verifier.GetHash()) {
+            throw std::ios_base::failure("checksum mismatch");
+        }
+        if (count == 0 || entries[0].first != consensus_params.hashGenesisBlock) {
+            throw std::ios_base::failure("unexpected genesis block");
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Block index snapshot is unusable (%s), loading block index from database\n", e.what());
+        return false;
+    }
+
+    m_block_index.reserve(entries.size());
+    sorted_by_height.reserve(entries.size());
+    for (const std::pair<uint256, CBlockIndex*>& entry : entries) {
+        BlockMap::iterator mi = m_block_index.emplace(entry.first, entry.second).first;
+        entry.second->phashBlock = &mi->first;
+        sorted_by_height.emplace_back(entry.second->nHeight, entry.second);
+    }
+    m_block_index_arena.swap(arena);
+
+    LogPrintf("Loaded %u block index entries from snapshot in %dms\n", entries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool BlockManager::LoadBlockIndex(
+    const Consensus::Params& consensus_params,
+    CBlockTreeDB& blocktree,
+    std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
+{
     std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    // A snapshot already carries nChainWork, nTimeMax and pskip
+    const bool from_snapshot = LoadSnapshot(consensus_params, blocktree, vSortedByHeight);
+    if (!from_snapshot) {
+        if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
+            return false;
+
+        vSortedByHeight.reserve(m_block_index.size());
+        for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        RelocateBlockIndex(vSortedByHeight);
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
+
+    // Calculate nChainWork
     for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
     {
         if (ShutdownRequested()) return false;
         CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        if (!from_snapshot) {
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+            pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        }
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -4350,7 +4708,7 @@ bool BlockManager::LoadBlockIndex(
         }
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
+        if (pindex->pprev && !from_snapshot)
             pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
@@ -4363,11 +4721,8 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_arena.Clear();
 }
 
 bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -4416,6 +4771,12 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Refuse a chainstate that an interrupted UTXO snapshot load left half written
+    bool fSnapshotLoading = false;
+    pblocktree->ReadFlag("utxosnapshotloading", fSnapshotLoading);
+    if (fSnapshotLoading)
+        return error("%s: loading a UTXO snapshot did not complete, restart with -reindex", __func__);
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -4464,6 +4825,151 @@ bool CChainState::LoadChainTip(const CChainParams& chainparams)
     return true;
 }
 
+bool CChainState::LoadUTXOSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, std::string& error)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
+
+    // Check the whole file against its commitment before touching the
+    // chainstate, so a corrupt or truncated snapshot leaves the node as it was.
+    const long coins_pos = ftell(coins_file.Get());
+    if (coins_pos < 0) {
+        error = "unable to determine snapshot file position";
+        return false;
+    }
+    if (!ReadUTXOSnapshot(coins_file, metadata, nullptr, error)) {
+        return false;
+    }
+    if (fseek(coins_file.Get(), coins_pos, SEEK_SET) != 0) {
+        error = "unable to rewind snapshot file";
+        return false;
+    }
+
+    {
+    LOCK(m_cs_chainstate);
+    LOCK(cs_main);
+
+    if (!fPruneMode) {
+        error = "loading a UTXO snapshot requires -prune, the blocks below it are never downloaded";
+        return false;
+    }
+    if (fAddrindex || fSpentIndex || fTimestampIndex) {
+        error = "loading a UTXO snapshot is incompatible with -addressindex, -spentindex and -timestampindex";
+        return false;
+    }
+    if (m_chain.Height() != 0) {
+        error = "the active chain must still be at the genesis block";
+        return false;
+    }
+    CBlockIndex* base = LookupBlockIndex(metadata.m_base_blockhash);
+    if (!base) {
+        error = strprintf("snapshot base block %s not found, wait for headers to sync", metadata.m_base_blockhash.ToString());
+        return false;
+    }
+    if (base->nHeight == 0 || (base->nStatus & BLOCK_FAILED_MASK)) {
+        error = strprintf("snapshot base block %s cannot become the tip", metadata.m_base_blockhash.ToString());
+        return false;
+    }
+
+    // From here on a failure leaves a partially populated chainstate behind;
+    // the flag makes the next start refuse it instead of building on it.
+    if (!pblocktree->WriteFlag("utxosnapshotloading", true) || !CoinsTip().Flush()) {
+        error = "unable to prepare the chainstate database";
+        return false;
+    }
+
+    CCoinsViewCache cache(&CoinsDB());
+    cache.SetBestBlock(base->GetBlockHash());
+    bool flushed = true;
+    uint64_t coins_loaded = 0;
+    const bool read = ReadUTXOSnapshot(coins_file, metadata, [&](const COutPoint& outpoint, Coin&& coin) {
+        cache.AddCoin(outpoint, std::move(coin), false);
+        if (++coins_loaded % 100000 == 0 && cache.DynamicMemoryUsage() > nCoinCacheUsage) {
+            flushed &= cache.Flush();
+        }
+    }, error);
+    if (!read || !flushed || !cache.Flush()) {
+        if (read) error = "failed to write to coin database";
+        error += ", restart with -reindex";
+        return false;
+    }
+    CoinsTip().SetBestBlock(base->GetBlockHash());
+
+    // The blocks below the snapshot are treated as connected under the current
+    // rules but pruned: those never received get a placeholder transaction
+    // count so that nChainTx stays meaningful, and their descendants can be
+    // linked from here.
+    std::vector<CBlockIndex*> path;
+    for (CBlockIndex* pindex = base; pindex->pprev; pindex = pindex->pprev) {
+        path.push_back(pindex);
+    }
+    m_chain.SetTip(base);
+    std::deque<CBlockIndex*> queue;
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        CBlockIndex* pindex = *it;
+        if (pindex->nTx == 0) pindex->nTx = 1;
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus())) {
+            pindex->nStatus |= BLOCK_OPT_WITNESS;
+        }
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+
+        auto range = m_blockman.m_blocks_unlinked.equal_range(pindex);
+        for (auto unlinked = range.first; unlinked != range.second; ++unlinked) {
+            if (!m_chain.Contains(unlinked->second)) queue.push_back(unlinked->second);
+        }
+        m_blockman.m_blocks_unlinked.erase(range.first, range.second);
+    }
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        {
+            LOCK(cs_nBlockSequenceId);
+            pindex->nSequenceId = nBlockSequenceId++;
+        }
+        if (!setBlockIndexCandidates.value_comp()(pindex, m_chain.Tip())) {
+            setBlockIndexCandidates.insert(pindex);
+        }
+        auto range = m_blockman.m_blocks_unlinked.equal_range(pindex);
+        for (auto unlinked = range.first; unlinked != range.second; ++unlinked) {
+            queue.push_back(unlinked->second);
+        }
+        m_blockman.m_blocks_unlinked.erase(range.first, range.second);
+    }
+    setBlockIndexCandidates.insert(base);
+    PruneBlockIndexCandidates();
+
+    fHavePruned = true;
+    pblocktree->WriteFlag("prunedblockfiles", true);
+    UpdateTip(base, chainparams);
+
+    CValidationState state;
+    if (!FlushStateToDisk(chainparams, state, FlushStateMode::ALWAYS) || !pblocktree->WriteFlag("utxosnapshotloading", false)) {
+        error = "failed to write the chainstate, restart with -reindex";
+        return false;
+    }
+
+    LogPrintf("Loaded %u coins from UTXO snapshot, new tip %s height=%d (%dms)\n",
+        coins_loaded, base->GetBlockHash().ToString(), base->nHeight, GetTimeMillis() - nStart);
+
+    const bool fInitialDownload = IsInitialBlockDownload();
+    GetMainSignals().UpdatedBlockTip(base, m_chain.Genesis(), fInitialDownload);
+    uiInterface.NotifyBlockTip(fInitialDownload, base);
+    }
+
+    CheckBlockIndex(chainparams.GetConsensus());
+
+    // Connect any blocks past the snapshot we already have
+    CValidationState state;
+    if (!ActivateBestChain(state, chainparams, nullptr)) {
+        error = strprintf("failed to activate best chain: %s", FormatStateMessage(state));
+        return false;
+    }
+    return true;
+}
+
 CVerifyDB::CVerifyDB()
 {
     uiInterface.ShowProgress(_("Verifying blocks...").translated, 0, false);
@@ -4902,6 +5408,179 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+/** Maximum number of bytes of parsed blocks buffered ahead of the consumer in LoadExternalBlockFile */
+static const uint64_t MAX_REINDEX_BYTES_AHEAD = 64 * 1024 * 1024;
+
+/** A block record found in a block file, together with the results of its off-thread processing */
+struct ParsedBlockRecord
+{
+    std::shared_ptr<CBlock> block;
+    unsigned int nPos{0};
+    unsigned int nSize{0};
+    uint256 hash;
+    bool fDone{false};
+};
+
+/**
+ * Pipeline behind LoadExternalBlockFile. A reader thread scans the file for
+ * block records and deserializes them, a pool of workers computes the block
+ * hashes and runs the context-free CheckBlock (proof of work, merkle root),
+ * and the calling thread consumes the records in file order. Blocks that
+ * pass CheckBlock are marked fChecked, so AcceptBlock does not redo the
+ * expensive multi-algo PoW hashing on the single validation thread.
+ */
+class BlockFilePipeline
+{
+public:
+    BlockFilePipeline(const CChainParams& chainparams, FILE* fileIn, int num_workers)
+        : m_chainparams(chainparams),
+          // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+          m_blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION)
+    {
+        m_reader = std::thread([this] { ReaderThread(); });
+        for (int i = 0; i < num_workers; i++) {
+            m_workers.emplace_back([this, i] { WorkerThread(i); });
+        }
+    }
+
+    ~BlockFilePipeline()
+    {
+        {
+            LOCK(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_reader.join();
+        for (std::thread& worker : m_workers) worker.join();
+    }
+
+    /** Wait for the next block record in file order. Returns false once the file is exhausted. */
+    bool Next(ParsedBlockRecord& record)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cond.wait(lock, [this] { return (!m_ordered.empty() && m_ordered.front()->fDone) || (m_ordered.empty() && m_reader_done); });
+        if (m_ordered.empty()) return false;
+        record = std::move(*m_ordered.front());
+        m_ordered.pop_front();
+        m_bytes_ahead -= record.nSize;
+        m_cond.notify_all();
+        return true;
+    }
+
+    /** Error that made the reader give up early, if any */
+    std::string GetError()
+    {
+        LOCK(m_mutex);
+        return m_error;
+    }
+
+private:
+    void ReaderThread()
+    {
+        util::ThreadRename("loadblk.read");
+        try {
+            uint64_t nRewind = m_blkdat.GetPos();
+            while (!m_blkdat.eof()) {
+                m_blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                m_blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    m_blkdat.FindByte(m_chainparams.MessageStart()[0]);
+                    nRewind = m_blkdat.GetPos()+1;
+                    m_blkdat >> buf;
+                    if (memcmp(buf, m_chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    m_blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    break;
+                }
+                auto record = std::make_shared<ParsedBlockRecord>();
+                try {
+                    // read block
+                    uint64_t nBlockPos = m_blkdat.GetPos();
+                    m_blkdat.SetLimit(nBlockPos + nSize);
+                    m_blkdat.SetPos(nBlockPos);
+                    record->block = std::make_shared<CBlock>();
+                    m_blkdat >> *record->block;
+                    nRewind = m_blkdat.GetPos();
+                    record->nPos = nBlockPos;
+                    record->nSize = nSize;
+                } catch (const std::exception& e) {
+                    LogPrintf("LoadExternalBlockFile: Deserialize or I/O error - %s\n", e.what());
+                    continue;
+                }
+
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [this] { return m_stop || m_bytes_ahead < MAX_REINDEX_BYTES_AHEAD; });
+                if (m_stop) break;
+                m_bytes_ahead += record->nSize;
+                m_ordered.push_back(record);
+                m_work.push_back(record);
+                m_cond.notify_all();
+            }
+        } catch (const std::runtime_error& e) {
+            LOCK(m_mutex);
+            m_error = e.what();
+        }
+        {
+            LOCK(m_mutex);
+            m_reader_done = true;
+        }
+        m_cond.notify_all();
+    }
+
+    void WorkerThread(int worker_num)
+    {
+        util::ThreadRename(strprintf("loadblk.%i", worker_num));
+        while (true) {
+            std::shared_ptr<ParsedBlockRecord> record;
+            {
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [this] { return m_stop || !m_work.empty() || m_reader_done; });
+                if (m_stop || m_work.empty()) return;
+                record = m_work.front();
+                m_work.pop_front();
+            }
+            record->hash = record->block->GetHash();
+            // Result is cached in fChecked; failures are reported again by AcceptBlock
+            CValidationState state;
+            CheckBlock(*record->block, state, m_chainparams.GetConsensus());
+            {
+                LOCK(m_mutex);
+                record->fDone = true;
+            }
+            m_cond.notify_all();
+        }
+    }
+
+    const CChainParams& m_chainparams;
+    CBufferedFile m_blkdat;
+    std::thread m_reader;
+    std::vector<std::thread> m_workers;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Parsed records in file order, waiting for the consumer
+    std::deque<std::shared_ptr<ParsedBlockRecord>> m_ordered GUARDED_BY(m_mutex);
+    //! Parsed records waiting for a worker
+    std::deque<std::shared_ptr<ParsedBlockRecord>> m_work GUARDED_BY(m_mutex);
+    uint64_t m_bytes_ahead GUARDED_BY(m_mutex){0};
+    bool m_reader_done GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::string m_error GUARDED_BY(m_mutex);
+};
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4910,45 +5589,18 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        BlockFilePipeline pipeline(chainparams, fileIn, std::max(nScriptCheckThreads, 1));
+        ParsedBlockRecord record;
+        while (pipeline.Next(record)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
-            }
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                    dbp->nPos = record.nPos;
+                std::shared_ptr<CBlock> pblock = record.block;
                 CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
 
-                uint256 hash = block.GetHash();
+                const uint256& hash = record.hash;
                 {
                     LOCK(cs_main);
                     // detect out of order blocks, and store them for later
@@ -5016,6 +5668,10 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
+        const std::string error = pipeline.GetError();
+        if (!error.empty()) {
+            AbortNode(std::string("System error: ") + error);
+        }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
@@ -5238,12 +5894,65 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! mempool.dat written in one go: each transaction with its time and fee delta, then the other fee deltas
+static const uint64_t MEMPOOL_DUMP_VERSION_SNAPSHOT = 1;
+//! mempool.dat as a sequence of segments, each appended by a dump with the changes since the one before
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Transactions re-admitted from mempool.dat per hold of cs_main
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+//! Records mempool.dat may hold beyond twice the live ones before it is rewritten, so a small mempool is not rewritten every time
+static const uint64_t MEMPOOL_DUMP_REWRITE_SLACK = 1000;
 
-bool LoadMempool(CTxMemPool& pool)
+/**
+ * What the last dump left in mempool.dat, so the next one only has to append
+ * what changed. Once the file holds more removed than live transactions it is
+ * written anew.
+ */
+struct MempoolDumpState {
+    //! transactions added by a segment and not removed by a later one
+    std::unordered_set<uint256, SaltedTxidHasher> live;
+    //! fee deltas of the last segment
+    std::map<uint256, CAmount> deltas;
+    //! additions and removals in all segments
+    uint64_t records{0};
+    //! size of the file once written; anything else means someone else changed it
+    uint64_t file_size{0};
+    bool valid{false};
+
+    void Clear()
+    {
+        live.clear();
+        deltas.clear();
+        records = 0;
+        file_size = 0;
+        valid = false;
+    }
+};
+static Mutex g_mempool_dump_mutex;
+static MempoolDumpState g_mempool_dump GUARDED_BY(g_mempool_dump_mutex);
+
+/**
+ * A segment: the transactions added since the previous segment, with their
+ * entry times, the txids of those removed since, and all fee deltas, which
+ * replace the ones of earlier segments.
+ */
+static void WriteMempoolSegment(CAutoFile& file, const std::vector<TxMempoolInfo>& added, const std::vector<uint256>& removed,
+                                const std::map<uint256, CAmount>& mapDeltas)
 {
-    const CChainParams& chainparams = Params();
-    int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    WriteCompactSize(file, added.size());
+    for (const auto& i : added) {
+        file << *(i.tx);
+        file << (int64_t)i.nTime;
+    }
+    file << removed;
+    file << mapDeltas;
+}
+
+bool ReadMempool(std::vector<std::pair<CTransactionRef, int64_t>>& txs, std::map<uint256, CAmount>& mapDeltas)
+{
+    txs.clear();
+    mapDeltas.clear();
+    WITH_LOCK(g_mempool_dump_mutex, g_mempool_dump.Clear());
     FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
     CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
     if (file.IsNull()) {
@@ -5251,38 +5960,141 @@ bool LoadMempool(CTxMemPool& pool)
         return false;
     }
 
-    int64_t count = 0;
-    int64_t expired = 0;
-    int64_t failed = 0;
-    int64_t already_there = 0;
-    int64_t nNow = GetTime();
-
     try {
         uint64_t version;
         file >> version;
+        if (version == MEMPOOL_DUMP_VERSION_SNAPSHOT) {
+            uint64_t num;
+            file >> num;
+            while (num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+                if (nFeeDelta) mapDeltas[tx->GetHash()] = nFeeDelta;
+                txs.emplace_back(std::move(tx), nTime);
+            }
+            std::map<uint256, CAmount> mapOtherDeltas;
+            file >> mapOtherDeltas;
+            mapDeltas.insert(mapOtherDeltas.begin(), mapOtherDeltas.end());
+            return true;
+        }
         if (version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
-        uint64_t num;
-        file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // Replay the segments, keeping the order transactions were first added in
+    std::map<uint256, size_t> index;
+    std::vector<std::pair<CTransactionRef, int64_t>> added;
+    uint64_t records = 0;
+    bool complete = true;
+    while (true) {
+        const int c = fgetc(file.Get());
+        if (c == EOF) break;
+        ungetc(c, file.Get());
+        std::vector<std::pair<CTransactionRef, int64_t>> segment_added;
+        std::vector<uint256> segment_removed;
+        std::map<uint256, CAmount> segment_deltas;
+        try {
+            uint64_t num = ReadCompactSize(file);
+            while (num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                file >> tx;
+                file >> nTime;
+                segment_added.emplace_back(std::move(tx), nTime);
+            }
+            file >> segment_removed;
+            file >> segment_deltas;
+        } catch (const std::exception& e) {
+            // A dump interrupted halfway leaves an incomplete last segment
+            LogPrintf("Ignoring incomplete mempool segment on disk: %s\n", e.what());
+            complete = false;
+            break;
+        }
+        for (auto& entry : segment_added) {
+            if (index.emplace(entry.first->GetHash(), added.size()).second) {
+                added.push_back(std::move(entry));
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
+        }
+        for (const uint256& hash : segment_removed) {
+            auto it = index.find(hash);
+            if (it != index.end()) {
+                added[it->second].first.reset();
+                index.erase(it);
+            }
+        }
+        mapDeltas = std::move(segment_deltas);
+        records += segment_added.size() + segment_removed.size();
+    }
+    for (auto& entry : added) {
+        if (entry.first) txs.push_back(std::move(entry));
+    }
+
+    // The next dump can append to this file, unless it was cut short
+    LOCK(g_mempool_dump_mutex);
+    if (complete) {
+        for (const auto& entry : txs) {
+            g_mempool_dump.live.insert(entry.first->GetHash());
+        }
+        g_mempool_dump.deltas = mapDeltas;
+        g_mempool_dump.records = records;
+        g_mempool_dump.file_size = (uint64_t)ftell(file.Get());
+        g_mempool_dump.valid = true;
+    }
+    return true;
+}
+
+bool LoadMempool(CTxMemPool& pool)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+
+    int64_t count = 0;
+    int64_t expired = 0;
+    int64_t failed = 0;
+    int64_t already_there = 0;
+    int64_t nNow = GetTime();
+
+    std::vector<std::pair<CTransactionRef, int64_t>> stored;
+    std::map<uint256, CAmount> mapDeltas;
+    if (!ReadMempool(stored, mapDeltas)) {
+        return false;
+    }
+    for (const auto& i : mapDeltas) {
+        pool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    std::vector<CTransactionRef> txs;
+    std::vector<int64_t> times;
+    for (auto& entry : stored) {
+        if (entry.second + nExpiryTimeout > nNow) {
+            txs.push_back(std::move(entry.first));
+            times.push_back(entry.second);
+        } else {
+            ++expired;
+        }
+    }
+    const std::vector<size_t> order = TopologicalOrder(txs);
+
+    // Re-admit a batch at a time, letting block validation and RPC at cs_main in between
+    for (size_t batch_start = 0; batch_start < order.size(); batch_start += MEMPOOL_LOAD_BATCH_SIZE) {
+        const size_t batch_end = std::min(order.size(), batch_start + MEMPOOL_LOAD_BATCH_SIZE);
+        LOCK(cs_main);
+        {
+            LOCK(pool.cs);
+            for (size_t n = batch_start; n < batch_end; ++n) {
+                const size_t i = order[n];
+                CValidationState state;
+                AcceptToMemoryPoolWithTimeNoFlush(chainparams, pool, state, txs[i], nullptr /* pfMissingInputs */, times[i],
+                                                  nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                                  false /* test_accept */);
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -5290,42 +6102,32 @@ bool LoadMempool(CTxMemPool& pool)
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
+                    if (pool.exists(txs[i]->GetHash())) {
                         ++already_there;
                     } else {
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
             }
-            if (ShutdownRequested())
-                return false;
-        }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto& i : mapDeltas) {
-            pool.PrioritiseTransaction(i.first, i.second);
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
+        CValidationState stateDummy;
+        ::ChainstateActive().FlushStateToDisk(chainparams, stateDummy, FlushStateMode::PERIODIC);
+        if (ShutdownRequested())
+            return false;
     }
 
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
     return true;
 }
 
-bool DumpMempool(const CTxMemPool& pool)
+bool DumpMempool(const CTxMemPool& pool, bool full)
 {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
 
-    static Mutex dump_mutex;
-    LOCK(dump_mutex);
+    LOCK(g_mempool_dump_mutex);
 
     {
         LOCK(pool.cs);
@@ -5337,32 +6139,81 @@ bool DumpMempool(const CTxMemPool& pool)
 
     int64_t mid = GetTimeMicros();
 
-    try {
-        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
-        if (!filestr) {
-            return false;
+    const fs::path path = GetDataDir() / "mempool.dat";
+    MempoolDumpState& dump = g_mempool_dump;
+    std::vector<TxMempoolInfo> added;
+    std::vector<uint256> removed;
+    if (!full && dump.valid && fs::exists(path) && fs::file_size(path) == dump.file_size) {
+        std::unordered_set<uint256, SaltedTxidHasher> current;
+        for (const auto& i : vinfo) {
+            current.insert(i.tx->GetHash());
+            if (!dump.live.count(i.tx->GetHash())) added.push_back(i);
+        }
+        for (const uint256& hash : dump.live) {
+            if (!current.count(hash)) removed.push_back(hash);
+        }
+        if (added.empty() && removed.empty() && mapDeltas == dump.deltas) {
+            return true;
         }
+        // Rewrite the file once most of what it holds is gone
+        full = dump.records + added.size() + removed.size() > 2 * vinfo.size() + MEMPOOL_DUMP_REWRITE_SLACK;
+    } else {
+        full = true;
+    }
 
-        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    try {
+        if (full) {
+            dump.valid = false;
+            FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
+            if (!filestr) {
+                return false;
+            }
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+            CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
-        }
+            uint64_t version = MEMPOOL_DUMP_VERSION;
+            file << version;
+            WriteMempoolSegment(file, vinfo, {}, mapDeltas);
 
-        file << mapDeltas;
-        if (!FileCommit(file.Get()))
-            throw std::runtime_error("FileCommit failed");
-        file.fclose();
-        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+            if (!FileCommit(file.Get()))
+                throw std::runtime_error("FileCommit failed");
+            file.fclose();
+            RenameOver(GetDataDir() / "mempool.dat.new", path);
+
+            dump.live.clear();
+            for (const auto& i : vinfo) {
+                dump.live.insert(i.tx->GetHash());
+            }
+            dump.records = vinfo.size();
+        } else {
+            // Should this fail halfway, the file is rewritten next time
+            dump.valid = false;
+            FILE* filestr = fsbridge::fopen(path, "ab");
+            if (!filestr) {
+                return false;
+            }
+
+            CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+            WriteMempoolSegment(file, added, removed, mapDeltas);
+
+            if (!FileCommit(file.Get()))
+                throw std::runtime_error("FileCommit failed");
+            file.fclose();
+
+            for (const auto& i : added) {
+                dump.live.insert(i.tx->GetHash());
+            }
+            for (const uint256& hash : removed) {
+                dump.live.erase(hash);
+            }
+            dump.records += added.size() + removed.size();
+        }
+        dump.deltas = std::move(mapDeltas);
+        dump.file_size = fs::file_size(path);
+        dump.valid = true;
         int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump%s\n", (mid-start)*MICRO, (last-mid)*MICRO,
+                  full ? "" : strprintf(" (%u added, %u removed)", added.size(), removed.size()));
     } catch (const std::exception& e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
         return false;
@@ -5370,6 +6221,13 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+bool DumpBlockIndexSnapshot()
+{
+    LOCK(cs_main);
+    if (!gArgs.GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT) || !pblocktree) return false;
+    return g_blockman.WriteSnapshot(*pblocktree, ::ChainActive().Tip());
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -5395,10 +6253,8 @@ public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = g_blockman.m_block_index.begin();
-        for (; it1 != g_blockman.m_block_index.end(); it1++)
-            delete (*it1).second;
         g_blockman.m_block_index.clear();
+        g_blockman.m_block_index_arena.Clear();
     }
 };
 static CMainCleanup instance_of_cmaincleanup;
\ No newline at end of file
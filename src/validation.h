@@ -35,6 +35,7 @@
 #include <utility>
 #include <vector>
 
+class CAutoFile;
 class CChainState;
 class CBlockIndex;
 class CBlockTreeDB;
@@ -51,6 +52,7 @@ struct ChainTxData;
 struct DisconnectedBlockTransactions;
 struct PrecomputedTransactionData;
 struct LockPoints;
+class SnapshotMetadata;
 
 /** Default for -minrelaytxfee, minimum relay fee for transactions */
 static const unsigned int DEFAULT_MIN_RELAY_TX_FEE = 1000;
@@ -62,6 +64,10 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in an in-mempool cluster */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 64;
+/** Default for -limitclustersize, maximum kilobytes of an in-mempool cluster */
+static const unsigned int DEFAULT_CLUSTER_SIZE_LIMIT = 101;
 /**
  * An extra transaction can be added to a package, as long as it only has one
  * ancestor and is no larger than this. Not really any reason to make this
@@ -83,7 +89,11 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Transactions with at least this many inputs have their scripts checked on the script-checking
+ *  threads when entering the mempool; smaller ones are checked on the calling thread. */
+static const unsigned int MIN_PARALLEL_MEMPOOL_SCRIPT_CHECK_INPUTS = 8;
+/** Number of blocks that can be requested at any given time from a single peer. The download
+ *  scheduler keeps slow peers below this, see BlockDownloadScheduler. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 32;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
@@ -95,10 +105,10 @@ static const unsigned int MAX_HEADERS_RESULTS = 10000;
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
 /** Maximum depth of blocks we're willing to respond to GETBLOCKTXN requests for. */
 static const int MAX_BLOCKTXN_DEPTH = 10;
-/** Size of the "block download window": how far ahead of our current height do we fetch?
+/** Maximum size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
+ *  degree of disordering of blocks on disk (which make reindexing and pruning harder). The download
+ *  scheduler shrinks the window when blocks validate slowly. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -124,6 +134,10 @@ static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Seconds between appending mempool changes to disk */
+static const int64_t DUMP_MEMPOOL_INTERVAL = 60 * 5;
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = true;
 /** Default for using fee filter */
 static const bool DEFAULT_FEEFILTER = true;
 
@@ -231,8 +245,9 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  * @param[in]  chainparams The params for the chain we want to connect to
  * @param[out] ppindex If set, the pointer will be set to point to the last new block index object for the given headers
  * @param[out] first_invalid First header that fails validation, if one exists
+ * @param[in]  fCheckPOW Set to false only if the caller already verified the proof of work of every header
  */
-bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr, CBlockHeader* first_invalid = nullptr) LOCKS_EXCLUDED(cs_main);
+bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex = nullptr, CBlockHeader* first_invalid = nullptr, bool fCheckPOW = true) LOCKS_EXCLUDED(cs_main);
 
 /** Open a block file (blk?????.dat) */
 FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
@@ -294,6 +309,13 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** (try to) add several transactions to memory pool, as AcceptToMemoryPool would one after the
+ * other, but taking the mempool lock and flushing the coins cache only once. Transactions that
+ * spend outputs of others in the batch are tried after them, whatever their order in txs.
+ * nAbsurdFees, states, missing_inputs and the result are indexed like txs. **/
+std::vector<bool> AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, const std::vector<CAmount>& nAbsurdFees,
+                        std::vector<CValidationState>& states, std::vector<bool>& missing_inputs) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Get the BIP9 state for a given deployment at the current tip. */
 ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::DeploymentPos pos);
 
@@ -380,6 +402,13 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/**
+ * Whether a block read with ReadRawBlockFromDisk carries no witness data, i.e.
+ * its disk serialization is identical to the SERIALIZE_TRANSACTION_NO_WITNESS one.
+ * Only valid for blocks that passed ContextualCheckBlock (anything stored on disk),
+ * as it relies on the coinbase carrying witness data whenever any transaction does.
+ */
+bool IsRawBlockWitnessFree(const std::vector<uint8_t>& block);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
@@ -455,6 +484,9 @@ class BlockManager {
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
+    /** Storage for all entries referenced by m_block_index. */
+    CBlockIndexArena m_block_index_arena GUARDED_BY(cs_main);
+
     /** In order to efficiently track invalidity of headers, we keep the set of
       * blocks which we tried to connect and found to be invalid here (ie which
       * were set to BLOCK_FAILED_VALID since the last restart). We can then
@@ -495,6 +527,27 @@ public:
         std::set<CBlockIndex*, CBlockIndexWorkComparator>& block_index_candidates)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Write every entry, including the memory-only chain work and skip
+     * pointers, to the block index snapshot file and record a matching marker
+     * in blocktree. Only valid right after the block index was flushed.
+     */
+    bool WriteSnapshot(CBlockTreeDB& blocktree, const CBlockIndex* tip) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /**
+     * Populate an empty m_block_index from the snapshot file if it matches the
+     * marker in blocktree, instead of reading and rehashing every database
+     * record. Entries are returned in height order.
+     */
+    bool LoadSnapshot(
+        const Consensus::Params& consensus_params,
+        CBlockTreeDB& blocktree,
+        std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /** Re-allocate freshly loaded entries in the given (height) order. */
+    void RelocateBlockIndex(std::vector<std::pair<int, CBlockIndex*>>& sorted_by_height) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     /** Clear all data members. */
     void Unload() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -505,12 +558,14 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     * fCheckPOW may only be false if the caller already verified the proof of work.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         CValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        bool fCheckPOW = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -739,6 +794,16 @@ public:
     /** Update the chain tip based on database information, i.e. CoinsTip()'s best block. */
     bool LoadChainTip(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Populate the UTXO set from a snapshot file positioned just after its
+     * `metadata`, and make the snapshot base block the active tip.
+     *
+     * Only allowed on a pruned node whose chain is still at genesis and which
+     * already has the header of the base block. The blocks below the base are
+     * never downloaded; the node treats them like pruned blocks.
+     */
+    bool LoadUTXOSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, std::string& error) LOCKS_EXCLUDED(cs_main);
+
 private:
     bool ActivateBestChainStep(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
     bool ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
@@ -810,12 +875,18 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
-bool DumpMempool(const CTxMemPool& pool);
+/** Dump the mempool to disk. Unless full is set, only what changed since the last dump or load is appended. */
+bool DumpMempool(const CTxMemPool& pool, bool full = true);
+
+/** Write a snapshot of the (flushed) block index to speed up the next startup */
+bool DumpBlockIndexSnapshot();
 
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Read the transactions stored on disk, in the order they were added, with their entry times, and the fee deltas, without adding them to the mempool. */
+bool ReadMempool(std::vector<std::pair<CTransactionRef, int64_t>>& txs, std::map<uint256, CAmount>& mapDeltas);
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -11,7 +11,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 3020191;
+static const int PROTOCOL_VERSION = 3020192;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -44,6 +44,9 @@ static const int SHORT_IDS_BLOCKS_VERSION = 3020191;
 //! not banning for invalid compact blocks starts with this version
 static const int INVALID_CB_NO_BAN_VERSION = 3020191;
 
+//! transaction reconciliation (BIP 330) messages start with this version
+static const int TXRECONCILIATION_VERSION = 3020192;
+
 //! first odo version
 static const int ODO_FORK_VERSION = 7001700;
 